@@ -11,14 +11,23 @@
 #include <iomanip>
 #include <sstream>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 #ifndef DISABLE_DATALOG_CUSTOMIZATION
 #include <unistd.h>
 #include <xtrf.h>
 #include <sys/types.h>
-#include <pwd.h>	// for getpwuid and geteuid
 #endif
 
 using namespace std;
@@ -31,11 +40,6 @@ using namespace tinyxml2;
 // load and will remain unchanged until the program gets unloaded.
 GlobalFloatS JobSetupTime("gJobSetupTime", RunTime.GetCurrentLocalTime(), INIT_ON_CREATION);
 
-template < typename T >
-std::string num2stdstring(T value) {
-	return static_cast< std::ostringstream* >(&(std::ostringstream() << value))->str();
-}
-
 #endif
 
 // Note to anyone making additions to the list of formatters
@@ -76,7 +80,14 @@ ST_Datalog() :
 	NumTestsExecuted(0),
 	FieldWidth(DefaultFieldWidth),
 	PassString(DefaultPassString),
-	FinishTime(UTL_VOID)
+	FinishTime(UTL_VOID),
+	AsyncFormatting(),
+	Writer(NULL),
+	Pool(new ST_DatalogPool()),
+	Shared(ST_SharedStage::Acquire()),
+	DeviceCount(0),
+	EventIndex(0),
+	TSRAccum(new ST_TSRAccumulator())
 {
 	RegisterAttribute(PerSiteSummary, "PerSiteSummary", true);
 	RegisterAttribute(EnableVerbose, "EnableVerbose", false);
@@ -87,6 +98,7 @@ ST_Datalog() :
 	RegisterAttribute(AppendPinName, "AppendPinName", true);
 	RegisterAttribute(UnitAutoscaling, "UnitAutoscaling", false);
 	RegisterAttribute(ASCIIOptimizeForUnscaledValues, "ASCIIOptimizeForUnscaledValues", false);
+	RegisterAttribute(AsyncFormatting, "AsyncFormatting", false);
 //	RegisterAttribute(EnableFullOpt, "EnableFullOptimization", false);
 
 	RegisterEvent(GetSystemEventName(DatalogMethod::StartOfTest), &ST_Datalog::StartOfTest);
@@ -109,17 +121,1203 @@ ST_Datalog() :
 	RegisterEvent(GetSystemEventName(DatalogMethod::Generic), &ST_Datalog::Generic);
 }
 
-ST_Datalog::
-~ST_Datalog()
-{
-}
-
 bool ST_Datalog::
 GetSummaryNeeded() const
 {
 	return SummaryNeeded;
 }
 
+// ***************************************************************************** 
+// ST_DatalogPool
+// Backing store for the per-event DatalogData objects and the prepared
+// parametric events they share (ST_PreparedParametric). Blocks are carved from
+// large slabs by size class and recycled through per-class free lists, so once
+// the slabs have grown to the working set of a device no event object touches
+// the general heap. Each block starts with a small header naming its pool and
+// size class, which lets the class-specific operator delete find its way back.
+// After each EndOfTest the pool is rewound wholesale when no object is
+// outstanding (checked when the next device starts).
+// Note: only the event objects live here, the Unison payload copies they hold
+// (DatalogParametric, PinML, StringS, ...) still manage their own memory.
+
+class ST_DatalogPool {
+public:
+	struct Counters {
+		unsigned long Allocations;			// event objects handed out since creation
+		unsigned long HeapAllocations;			// slabs and oversized blocks taken from the heap
+		unsigned long Outstanding;			// event objects not yet deleted
+		unsigned long DeviceAllocations;		// event objects in the last completed device
+		unsigned long DeviceHeapAllocations;		// heap allocations in the last completed device
+		unsigned long Rewinds;				// wholesale resets at EndOfTest
+	};
+
+	ST_DatalogPool();
+
+	void *Allocate(size_t size);
+	static void Free(void *ptr);
+	void EndOfDevice();
+	void Release();					// owner is gone, delete with the last object
+	Counters GetCounters();
+private:
+	struct Header {
+		ST_DatalogPool *Pool;
+		unsigned int SizeClass;
+	};
+	static const size_t HeaderSize = 16;		// keeps the objects 16 byte aligned
+	static const size_t MinClassSize = 64;
+	static const unsigned int NumClasses = 7;	// 64 bytes up to 4K, larger goes to the heap
+	static const size_t SlabSize = 65536;
+
+	std::mutex Lock;
+	std::vector<char *> Slabs;
+	size_t CurSlab;					// slab being carved
+	size_t CurOffset;				// next free byte in that slab
+	void *FreeLists[NumClasses];
+	bool Released;
+	Counters Count;
+	unsigned long DeviceAllocations;
+	unsigned long DeviceHeapAllocations;
+
+	~ST_DatalogPool();
+	static unsigned int GetSizeClass(size_t size);
+
+	ST_DatalogPool(const ST_DatalogPool &);		// disable copy
+	ST_DatalogPool &operator=(const ST_DatalogPool &);	// disable copy
+};
+
+ST_DatalogPool::
+ST_DatalogPool() :
+	Lock(),
+	Slabs(),
+	CurSlab(0),
+	CurOffset(0),
+	Released(false),
+	Count(),
+	DeviceAllocations(0),
+	DeviceHeapAllocations(0)
+{
+	memset(FreeLists, 0, sizeof(FreeLists));
+	memset(&Count, 0, sizeof(Count));
+}
+
+ST_DatalogPool::
+~ST_DatalogPool()
+{
+	for (std::vector<char *>::const_iterator it = Slabs.begin(); it != Slabs.end(); ++it)
+		::operator delete(*it);
+}
+
+unsigned int ST_DatalogPool::
+GetSizeClass(size_t size)
+{
+	unsigned int cls = 0;
+	for (size_t csize = MinClassSize; (cls < NumClasses) && (csize < size + HeaderSize); csize <<= 1)
+		++cls;
+	return cls;					// NumClasses means oversized
+}
+
+void *ST_DatalogPool::
+Allocate(size_t size)
+{
+	const unsigned int cls = GetSizeClass(size);
+	char *block = NULL;
+	std::lock_guard<std::mutex> lock(Lock);
+	if (cls >= NumClasses) {
+		block = static_cast<char *>(::operator new(size + HeaderSize));
+		++Count.HeapAllocations;
+		++DeviceHeapAllocations;
+	}
+	else if (FreeLists[cls] != NULL) {
+		block = static_cast<char *>(FreeLists[cls]);
+		FreeLists[cls] = *reinterpret_cast<void **>(block + HeaderSize);
+	}
+	else {
+		const size_t csize = MinClassSize << cls;
+		if ((CurSlab < Slabs.size()) && (CurOffset + csize > SlabSize)) {
+			++CurSlab;
+			CurOffset = 0;
+		}
+		if (CurSlab >= Slabs.size()) {
+			Slabs.push_back(static_cast<char *>(::operator new(SlabSize)));
+			CurSlab = Slabs.size() - 1;
+			CurOffset = 0;
+			++Count.HeapAllocations;
+			++DeviceHeapAllocations;
+		}
+		block = Slabs[CurSlab] + CurOffset;
+		CurOffset += csize;
+	}
+	Header *hdr = reinterpret_cast<Header *>(block);
+	hdr -> Pool = this;
+	hdr -> SizeClass = cls;
+	++Count.Allocations;
+	++Count.Outstanding;
+	++DeviceAllocations;
+	return block + HeaderSize;
+}
+
+void ST_DatalogPool::
+Free(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	char *block = static_cast<char *>(ptr) - HeaderSize;
+	const Header *hdr = reinterpret_cast<const Header *>(block);
+	ST_DatalogPool *pool = hdr -> Pool;
+	bool last = false;
+	{
+		std::lock_guard<std::mutex> lock(pool -> Lock);
+		if (hdr -> SizeClass >= NumClasses)
+			::operator delete(block);
+		else {
+			*reinterpret_cast<void **>(ptr) = pool -> FreeLists[hdr -> SizeClass];
+			pool -> FreeLists[hdr -> SizeClass] = block;
+		}
+		--pool -> Count.Outstanding;
+		last = pool -> Released && (pool -> Count.Outstanding == 0);
+	}
+	if (last)
+		delete pool;
+}
+
+void ST_DatalogPool::
+EndOfDevice()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	Count.DeviceAllocations = DeviceAllocations;
+	Count.DeviceHeapAllocations = DeviceHeapAllocations;
+	DeviceAllocations = 0;
+	DeviceHeapAllocations = 0;
+	// Objects still held by the system keep their blocks, the free
+	// lists recycle them. Otherwise start carving from the first slab again.
+	if (Count.Outstanding == 0) {
+		memset(FreeLists, 0, sizeof(FreeLists));
+		CurSlab = 0;
+		CurOffset = 0;
+		++Count.Rewinds;
+	}
+}
+
+void ST_DatalogPool::
+Release()
+{
+	bool last = false;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		Released = true;
+		last = (Count.Outstanding == 0);
+	}
+	if (last)
+		delete this;
+}
+
+ST_DatalogPool::Counters ST_DatalogPool::
+GetCounters()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	return Count;
+}
+
+// ***************************************************************************** 
+// ST_SiteSet
+// Compact bitset of site numbers for the selected, datalogged and failing
+// site lists. Membership is a single bit test, instead of the linear scan of a
+// Sites list, and iteration walks the set bits in ascending site order with
+// count-trailing-zeros. The set grows with the largest site added, so it is
+// not tied to the current __MaxSite.
+
+class ST_SiteSet {
+public:
+	class Iter {
+	public:
+		bool End() const;
+		SITE operator*() const;
+		Iter &operator++();
+	private:
+		const ST_SiteSet *Set;
+		size_t Word;
+		unsigned long long Bits;		// bits of Word not visited yet
+
+		Iter(const ST_SiteSet &set);
+		void Skip();
+
+		friend class ST_SiteSet;
+	};
+
+	ST_SiteSet();
+	explicit ST_SiteSet(const Sites &sites);
+
+	void Assign(const Sites &sites);
+	void Add(SITE site);
+	bool Contains(SITE site) const;
+	int Count() const;
+	bool Empty() const;
+	Iter Begin() const;
+	bool operator==(const ST_SiteSet &set) const;
+private:
+	static const unsigned int WordBits = 64;
+	std::vector<unsigned long long> Words;
+};
+
+ST_SiteSet::Iter::
+Iter(const ST_SiteSet &set) :
+	Set(&set),
+	Word(0),
+	Bits(set.Words.empty() ? 0 : set.Words[0])
+{
+	Skip();
+}
+
+void ST_SiteSet::Iter::
+Skip()
+{
+	while ((Bits == 0) && (Word + 1 < Set -> Words.size()))
+		Bits = Set -> Words[++Word];
+}
+
+bool ST_SiteSet::Iter::
+End() const
+{
+	return Bits == 0;
+}
+
+SITE ST_SiteSet::Iter::
+operator*() const
+{
+	return SITE(Word * WordBits + __builtin_ctzll(Bits));
+}
+
+ST_SiteSet::Iter &ST_SiteSet::Iter::
+operator++()
+{
+	Bits &= Bits - 1;				// clear the lowest set bit
+	Skip();
+	return *this;
+}
+
+ST_SiteSet::
+ST_SiteSet() :
+	Words()
+{
+}
+
+ST_SiteSet::
+ST_SiteSet(const Sites &sites) :
+	Words()
+{
+	Assign(sites);
+}
+
+void ST_SiteSet::
+Assign(const Sites &sites)
+{
+	std::fill(Words.begin(), Words.end(), 0);
+	for (SiteIter s1 = sites.Begin(); !s1.End(); ++s1)
+		Add(*s1);
+}
+
+void ST_SiteSet::
+Add(SITE site)
+{
+	const size_t word = size_t(site) / WordBits;
+	if (word >= Words.size())
+		Words.resize(word + 1, 0);
+	Words[word] |= 1ULL << (size_t(site) % WordBits);
+}
+
+bool ST_SiteSet::
+Contains(SITE site) const
+{
+	const size_t word = size_t(site) / WordBits;
+	return (word < Words.size()) && ((Words[word] >> (size_t(site) % WordBits)) & 1);
+}
+
+int ST_SiteSet::
+Count() const
+{
+	int count = 0;
+	for (std::vector<unsigned long long>::const_iterator it = Words.begin(); it != Words.end(); ++it)
+		count += __builtin_popcountll(*it);
+	return count;
+}
+
+bool ST_SiteSet::
+Empty() const
+{
+	for (std::vector<unsigned long long>::const_iterator it = Words.begin(); it != Words.end(); ++it)
+		if (*it != 0)
+			return false;
+	return true;
+}
+
+ST_SiteSet::Iter ST_SiteSet::
+Begin() const
+{
+	return Iter(*this);
+}
+
+bool ST_SiteSet::
+operator==(const ST_SiteSet &set) const
+{
+	const std::vector<unsigned long long> &longer = (Words.size() >= set.Words.size()) ? Words : set.Words;
+	const std::vector<unsigned long long> &shorter = (Words.size() >= set.Words.size()) ? set.Words : Words;
+	for (size_t ii = 0; ii < longer.size(); ii++)
+		if (longer[ii] != ((ii < shorter.size()) ? shorter[ii] : 0))
+			return false;
+	return true;
+}
+
+// Numeric value of a valid scalar BasicVar, false for arrays and non-numeric types
+static bool GetScalarValue(const BasicVar &var, double &value)
+{
+	if (!var.Valid() || (var.GetConfig() == SV_ARRAY_S1D))
+		return false;
+	switch (var.GetType()) {
+	case SV_FLOAT:
+		value = double(var.GetFloatS());
+		return true;
+	case SV_INT:
+		value = double(int(var.GetIntS()));
+		return true;
+	case SV_UINT:
+		value = double((unsigned int)var.GetUnsignedS());
+		return true;
+	default:
+		return false;
+	}
+}
+
+// ***************************************************************************** 
+// ST_UnitScaleCache
+// Memoizes the unit scale resolution of the parametric events. The system
+// routines parse the unit string on every call; the result only depends on
+// the unit and, for auto ranging, on the magnitude of the value and limits, so
+// repeated executions of a test resolve with a lookup. Entries are keyed by
+// test ID, resolution kind, unit and one bucket per value, and remember the
+// unit string they were built from so a hash collision is never returned.
+// A value well inside a decade is bucketed by its decade. Close to a power of
+// ten the system's rounding decides which range it falls in (999.96 may be
+// shown as 1.000k), so such a value is never cached and the system resolves
+// it every time. The width of that band follows from the digits the ASCII
+// field prints, see GetEdgeBand().
+// Cleared on ProgramReset and when the active limit table changes.
+
+class ST_UnitScaleCache {
+public:
+	enum Kind {
+		UNIT_SCALE,					// CalculateUnitScale
+		BASE_UNIT_SCALE,				// CalculateBaseUnitScale
+		AUTO_RANGE_SCALE				// CalculateAutoRangeUnitScale
+	};
+	struct Bucket {
+		int Decade;
+	};
+	static const int NumBuckets = 3;		// test value, low and high limit
+
+	ST_UnitScaleCache();
+
+	bool Find(unsigned int test_id, Kind kind, const StringS &units, const Bucket *buckets, double &scale, StringS &real_units);
+	void Insert(unsigned int test_id, Kind kind, const StringS &units, const Bucket *buckets, double scale, const StringS &real_units, bool set_units);
+	void Clear();
+	void SetLimitTable(const StringS &name);
+	static double GetEdgeBand(int fraction_digits);
+	static bool GetBucket(const BasicVar &var, double edge_band, Bucket &bucket);
+private:
+	struct Key {
+		unsigned int TestID;
+		int Kind;
+		Bucket Buckets[NumBuckets];
+		size_t UnitsHash;
+		bool operator==(const Key &key) const;
+	};
+	struct KeyHash {
+		size_t operator()(const Key &key) const;
+	};
+	struct Entry {
+		StringS Units;				// unit string the entry was resolved from
+		StringS RealUnits;
+		double Scale;
+		bool SetUnits;				// false when the system left real_units untouched
+	};
+	typedef std::unordered_map<Key, Entry, KeyHash> EntryMap;
+
+	std::mutex Lock;				// shared by all datalog instances
+	EntryMap Entries;
+	StringS LimitTable;
+
+	static Key MakeKey(unsigned int test_id, Kind kind, const StringS &units, const Bucket *buckets);
+
+	ST_UnitScaleCache(const ST_UnitScaleCache &);		// disable copy
+	ST_UnitScaleCache &operator=(const ST_UnitScaleCache &);	// disable copy
+};
+
+ST_UnitScaleCache::
+ST_UnitScaleCache() :
+	Lock(),
+	Entries(),
+	LimitTable()
+{
+}
+
+bool ST_UnitScaleCache::Key::
+operator==(const Key &key) const
+{
+	if ((TestID != key.TestID) || (Kind != key.Kind) || (UnitsHash != key.UnitsHash))
+		return false;
+	for (int ii = 0; ii < NumBuckets; ++ii)
+		if (Buckets[ii].Decade != key.Buckets[ii].Decade)
+			return false;
+	return true;
+}
+
+size_t ST_UnitScaleCache::KeyHash::
+operator()(const Key &key) const
+{
+	size_t hash = key.UnitsHash ^ (size_t(key.TestID) * 2654435761u) ^ size_t(key.Kind);
+	for (int ii = 0; ii < NumBuckets; ++ii)
+		hash = (hash * 31) + size_t(key.Buckets[ii].Decade);
+	return hash;
+}
+
+ST_UnitScaleCache::Key ST_UnitScaleCache::
+MakeKey(unsigned int test_id, Kind kind, const StringS &units, const Bucket *buckets)
+{
+	Key key;
+	key.TestID = test_id;
+	key.Kind = kind;
+	for (int ii = 0; ii < NumBuckets; ++ii)
+		key.Buckets[ii].Decade = (buckets != NULL) ? buckets[ii].Decade : 0;
+	// FNV-1a over the unit string
+	size_t hash = 2166136261u;
+	const char *str = (const char *)units;
+	for (int ii = 0; ii < units.Length(); ++ii)
+		hash = (hash ^ (unsigned char)str[ii]) * 16777619u;
+	key.UnitsHash = hash;
+	return key;
+}
+
+bool ST_UnitScaleCache::
+Find(unsigned int test_id, Kind kind, const StringS &units, const Bucket *buckets, double &scale, StringS &real_units)
+{
+	const Key key = MakeKey(test_id, kind, units, buckets);
+	std::lock_guard<std::mutex> lock(Lock);
+	EntryMap::const_iterator it = Entries.find(key);
+	if ((it == Entries.end()) || (it -> second.Units.Length() != units.Length()) ||
+	    (strcmp((const char *)it -> second.Units, (const char *)units) != 0))
+		return false;
+	scale = it -> second.Scale;
+	if (it -> second.SetUnits)
+		real_units = it -> second.RealUnits;
+	return true;
+}
+
+void ST_UnitScaleCache::
+Insert(unsigned int test_id, Kind kind, const StringS &units, const Bucket *buckets, double scale, const StringS &real_units, bool set_units)
+{
+	const Key key = MakeKey(test_id, kind, units, buckets);
+	std::lock_guard<std::mutex> lock(Lock);
+	Entry &entry = Entries[key];
+	entry.Units = units;
+	entry.RealUnits = real_units;
+	entry.Scale = scale;
+	entry.SetUnits = set_units;
+}
+
+void ST_UnitScaleCache::
+Clear()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	Entries.clear();
+}
+
+void ST_UnitScaleCache::
+SetLimitTable(const StringS &name)
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	if ((LimitTable.Length() != name.Length()) || (strcmp((const char *)LimitTable, (const char *)name) != 0)) {
+		Entries.clear();
+		LimitTable = name;
+	}
+}
+
+// Relative width of the bands next to a power of ten that are not cached.
+// The ASCII field shows fraction_digits digits after the point, so rounding
+// moves the shown value by at most half a unit of the last digit. The range
+// follows the largest of the values, which the system scales to at least 1,
+// so relative to it the move is at most 0.5 * 10^-fraction_digits. Without
+// a digit after the point nothing is cached.
+double ST_UnitScaleCache::
+GetEdgeBand(int fraction_digits)
+{
+	if (fraction_digits < 1)
+		return 1.0;
+	return 0.5 * pow(10.0, -fraction_digits);
+}
+
+// Bucket of a scalar value. Void and zero values are buckets of their own.
+// Returns false for arrays, for anything that is not a finite number and for
+// values within edge_band (relative) of a power of ten, those are resolved by
+// the system every time.
+bool ST_UnitScaleCache::
+GetBucket(const BasicVar &var, double edge_band, Bucket &bucket)
+{
+	if (!var.Valid()) {
+		bucket.Decade = INT_MIN;
+		return true;
+	}
+	double value;
+	if (!GetScalarValue(var, value))
+		return false;
+	if (value == 0.0) {
+		bucket.Decade = INT_MIN + 1;
+		return true;
+	}
+	if (!std::isfinite(value))
+		return false;
+	const double magnitude = fabs(value);
+	const int decade = (int)floor(log10(magnitude));
+	const double mantissa = magnitude / pow(10.0, decade);
+	if ((mantissa < 1.0 + edge_band) || (mantissa >= 10.0 * (1.0 - edge_band)))
+		return false;
+	bucket.Decade = decade;
+	return true;
+}
+
+// ***************************************************************************** 
+// ST_DescriptionCache
+// Lot-scoped cache of the final parametric test description (comment or
+// TestName/BlockName, plus the appended pin names) and of the formatted pin
+// string. Both are rebuilt from the same inputs on every device otherwise.
+// Entries are keyed by test ID and flow node (TestName/BlockName): the comment
+// and pins of a test in a flow node are fixed by the test program, so a hit
+// does not look at them again. The pin string is only built for the callers
+// that print it. Entries stay in place until Clear() at StartOfLot.
+
+class ST_DescriptionCache {
+public:
+	struct Entry {
+		StringS TestName;
+		StringS BlockName;
+		bool AppendPin;
+		bool HasPinString;
+		StringS Description;			// final test description
+		StringS PinString;			// FormatPins() result, PGSize wide, once HasPinString is set
+	};
+
+	ST_DescriptionCache();
+
+	Entry *Find(unsigned int test_id, const StringS &test_name, const StringS &block_name, bool append_pin);
+	Entry &Insert(unsigned int test_id, const StringS &test_name, const StringS &block_name, bool append_pin);
+	void Clear();
+private:
+	typedef std::unordered_multimap<unsigned int, Entry> EntryMap;	// node based, entries never move
+
+	std::mutex Lock;				// shared by all datalog instances
+	EntryMap Entries;
+
+	static bool IsSameString(const StringS &str1, const StringS &str2);
+
+	ST_DescriptionCache(const ST_DescriptionCache &);		// disable copy
+	ST_DescriptionCache &operator=(const ST_DescriptionCache &);	// disable copy
+};
+
+ST_DescriptionCache::
+ST_DescriptionCache() :
+	Lock(),
+	Entries()
+{
+}
+
+bool ST_DescriptionCache::
+IsSameString(const StringS &str1, const StringS &str2)
+{
+	if (!str1.Valid() || !str2.Valid())
+		return str1.Valid() == str2.Valid();
+	return (str1.Length() == str2.Length()) && (strcmp((const char *)str1, (const char *)str2) == 0);
+}
+
+ST_DescriptionCache::Entry *ST_DescriptionCache::
+Find(unsigned int test_id, const StringS &test_name, const StringS &block_name, bool append_pin)
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	std::pair<EntryMap::iterator, EntryMap::iterator> range = Entries.equal_range(test_id);
+	for (EntryMap::iterator it = range.first; it != range.second; ++it) {
+		Entry &entry = it -> second;
+		if ((entry.AppendPin == append_pin) && IsSameString(entry.TestName, test_name) && IsSameString(entry.BlockName, block_name))
+			return &entry;
+	}
+	return NULL;
+}
+
+ST_DescriptionCache::Entry &ST_DescriptionCache::
+Insert(unsigned int test_id, const StringS &test_name, const StringS &block_name, bool append_pin)
+{
+	Entry entry;
+	entry.TestName = test_name;
+	entry.BlockName = block_name;
+	entry.AppendPin = append_pin;
+	entry.HasPinString = false;
+	std::lock_guard<std::mutex> lock(Lock);
+	return Entries.insert(EntryMap::value_type(test_id, entry)) -> second;
+}
+
+void ST_DescriptionCache::
+Clear()
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	Entries.clear();
+}
+
+// ***************************************************************************** 
+// ST_SharedStage
+// Pre-format state shared by every ST_Datalog DatalogObject in the program
+// (BinChecker registers one for ASCII and one for STDFV4). The unit scale and
+// description caches live here so they are filled once for all formats, and
+// each parametric event is prepared once: the first instance to see it copies
+// the payload into an ST_PreparedParametric, the other instances pick up the
+// same object. A prepared event is identified by the system's event pointer,
+// test ID and the position of the event in the device, as counted by each
+// instance; any instance whose count disagrees simply prepares its own copy.
+// Prepared events come from the pool of the instance that prepared them, and
+// are created and released on the test thread. In async mode the writer
+// thread of an ASCII instance also reads their values, which do not change
+// once prepared (see ST_DatalogWriter). The stage lets go of the last one at
+// EndOfTest, so it does not keep a pool from rewinding.
+
+class ST_PreparedParametric {
+public:
+	ST_PreparedParametric(const DatalogParametric &pdata, const DatalogBaseUserData *udata, unsigned long device, unsigned long index);
+
+	// Prepared events live in the pool of the preparing instance: new (pool) ST_PreparedParametric(...)
+	static void *operator new(size_t size, ST_DatalogPool &pool);
+	static void operator delete(void *ptr, ST_DatalogPool &pool);
+	static void operator delete(void *ptr);
+
+	const DatalogParametric PData;			// the payload, copied once for all instances
+
+	bool IsEvent(const DatalogBaseUserData *udata, unsigned int test_id, unsigned long device, unsigned long index) const;
+	Sites GetFailSites(const Sites &dlog_sites);
+	void AddRef();
+	void Release();
+private:
+	const DatalogBaseUserData *UserData;		// identity only, never dereferenced
+	unsigned long Device;
+	unsigned long Index;
+	std::atomic<unsigned int> RefCount;
+	bool FailSitesValid;
+	ST_SiteSet DlogSites;				// the sites FailSites was filtered from
+	Sites FailSites;				// the datalogged sites with only the failing sites left
+
+	ST_PreparedParametric(const ST_PreparedParametric &);		// disable copy
+	ST_PreparedParametric &operator=(const ST_PreparedParametric &);	// disable copy
+};
+
+ST_PreparedParametric::
+ST_PreparedParametric(const DatalogParametric &pdata, const DatalogBaseUserData *udata, unsigned long device, unsigned long index) :
+	PData(pdata),
+	UserData(udata),
+	Device(device),
+	Index(index),
+	RefCount(0),
+	FailSitesValid(false),
+	DlogSites(),
+	FailSites()
+{
+}
+
+void *ST_PreparedParametric::
+operator new(size_t size, ST_DatalogPool &pool)
+{
+	return pool.Allocate(size);
+}
+
+void ST_PreparedParametric::
+operator delete(void *ptr, ST_DatalogPool &)
+{
+	ST_DatalogPool::Free(ptr);			// only called when the constructor throws
+}
+
+void ST_PreparedParametric::
+operator delete(void *ptr)
+{
+	ST_DatalogPool::Free(ptr);
+}
+
+bool ST_PreparedParametric::
+IsEvent(const DatalogBaseUserData *udata, unsigned int test_id, unsigned long device, unsigned long index) const
+{
+	return (UserData == udata) && (Device == device) && (Index == index) && ((unsigned int)PData.GetTestID() == test_id);
+}
+
+// Fail-only site filtering, done once per event for every format that asks
+Sites ST_PreparedParametric::
+GetFailSites(const Sites &dlog_sites)
+{
+	const ST_SiteSet dlog_set(dlog_sites);
+	if (!FailSitesValid || !(DlogSites == dlog_set)) {
+		DlogSites = dlog_set;
+		FailSites = dlog_sites;
+		(void)FailSites.DisableFailingSites(PData.GetResult().Equal(TM_FAIL));	// This removes anything that is not a fail due to Equal
+		FailSitesValid = true;
+	}
+	return FailSites;
+}
+
+void ST_PreparedParametric::
+AddRef()
+{
+	RefCount.fetch_add(1);
+}
+
+void ST_PreparedParametric::
+Release()
+{
+	if (RefCount.fetch_sub(1) == 1)
+		delete this;
+}
+
+class ST_SharedStage {
+public:
+	static ST_SharedStage *Acquire();
+	void Release();
+
+	ST_UnitScaleCache ScaleCache;
+	ST_DescriptionCache DescCache;
+
+	// Returns the prepared event with a reference for the caller, new ones are taken from pool
+	ST_PreparedParametric *Prepare(const DatalogParametric &pdata, const DatalogBaseUserData *udata, unsigned long device, unsigned long index,
+	                               ST_DatalogPool &pool);
+	void EndOfDevice();
+private:
+	unsigned int Users;				// ST_Datalog instances, guarded by GetLock()
+	ST_PreparedParametric *Current;			// last prepared parametric event
+	static ST_SharedStage *Instance;
+
+	ST_SharedStage();
+	~ST_SharedStage();
+	static std::mutex &GetLock();
+
+	ST_SharedStage(const ST_SharedStage &);		// disable copy
+	ST_SharedStage &operator=(const ST_SharedStage &);	// disable copy
+};
+
+ST_SharedStage *ST_SharedStage::Instance = NULL;
+
+ST_SharedStage::
+ST_SharedStage() :
+	ScaleCache(),
+	DescCache(),
+	Users(0),
+	Current(NULL)
+{
+}
+
+ST_SharedStage::
+~ST_SharedStage()
+{
+	if (Current != NULL)
+		Current -> Release();
+}
+
+std::mutex &ST_SharedStage::
+GetLock()
+{
+	static std::mutex lock;
+	return lock;
+}
+
+ST_SharedStage *ST_SharedStage::
+Acquire()
+{
+	std::lock_guard<std::mutex> lock(GetLock());
+	if (Instance == NULL)
+		Instance = new ST_SharedStage();
+	++Instance -> Users;
+	return Instance;
+}
+
+void ST_SharedStage::
+Release()
+{
+	std::lock_guard<std::mutex> lock(GetLock());
+	if (--Users == 0) {
+		Instance = NULL;
+		delete this;
+	}
+}
+
+ST_PreparedParametric *ST_SharedStage::
+Prepare(const DatalogParametric &pdata, const DatalogBaseUserData *udata, unsigned long device, unsigned long index, ST_DatalogPool &pool)
+{
+	// The handlers of all instances run on the test thread, one after the other
+	if ((Current == NULL) || !Current -> IsEvent(udata, pdata.GetTestID(), device, index)) {
+		if (Current != NULL)
+			Current -> Release();
+		Current = new (pool) ST_PreparedParametric(pdata, udata, device, index);
+		Current -> AddRef();
+	}
+	Current -> AddRef();
+	return Current;
+}
+
+// Every instance has seen the last parametric event of the device by its EndOfTest
+void ST_SharedStage::
+EndOfDevice()
+{
+	if (Current != NULL) {
+		Current -> Release();
+		Current = NULL;
+	}
+}
+
+// ***************************************************************************** 
+// ST_TSRAccumulator
+// Running per-test totals for the STDF TSR records, updated as the test events
+// arrive so the summary does not have to reduce TSRInfo over every site and
+// test record at lot end. Totals are kept for all sites together; the per-site
+// TSR records are still written straight from TSRInfo. Every summary closes
+// the current scope and starts a new one, so a sublot or partial summary is
+// covered by the scopes since the last summary that reset the counts, and the
+// final summary by all of them. The summary only uses the totals when the
+// latest scopes add up to exactly the devices it covers, and falls back to
+// the TSRInfo reduction otherwise. Cleared at StartOfLot.
+// Build with ST_DATALOG_VERIFY_TSR to check every total the summary uses
+// against the TSRInfo reduction.
+
+class ST_TSRAccumulator {
+public:
+	struct Stats {
+		unsigned int NumTested;
+		unsigned int NumFails;
+		double MinValue;
+		double MaxValue;
+		double Sums;
+		double SumOfSquares;
+		bool HasValues;				// parametric values were accumulated
+		bool Partial;				// an event was seen that is not accumulated
+	};
+
+	typedef std::unordered_map<unsigned int, Stats> StatsMap;
+
+	ST_TSRAccumulator();
+
+	void Clear();
+	void AddParametric(const DatalogParametric &pdata);
+	void AddFunctional(unsigned int test_id, const TMResultM &res);
+	void AddPartial(unsigned int test_id);
+	void EndOfDevice();
+	void EndOfSummary();
+	bool Collect(unsigned long num_devices, StatsMap &totals) const;
+#ifdef ST_DATALOG_VERIFY_TSR
+	static bool IsSameStats(const Stats &stats1, const Stats &stats2);
+#endif
+private:
+	struct Scope {
+		StatsMap Totals;
+		unsigned long NumDevices;		// EndOfTest events in this scope
+	};
+	struct Slot {
+		unsigned int TestID;
+		Stats *Totals;				// in the open scope
+	};
+
+	std::vector<Scope> Scopes;			// one per summary since StartOfLot, the last one is open
+	std::vector<Slot> Slots;			// totals used by each event position of the last device
+	size_t Position;				// events so far in the current device
+
+	Stats &GetStats(unsigned int test_id);
+	Stats &FindStats(unsigned int test_id);
+	static void InitStats(Stats &stats);
+	static void MergeStats(Stats &stats, const Stats &from);
+
+	ST_TSRAccumulator(const ST_TSRAccumulator &);		// disable copy
+	ST_TSRAccumulator &operator=(const ST_TSRAccumulator &);	// disable copy
+};
+
+ST_TSRAccumulator::
+ST_TSRAccumulator() :
+	Scopes(1),
+	Slots(),
+	Position(0)
+{
+	Scopes.back().NumDevices = 0;
+}
+
+void ST_TSRAccumulator::
+Clear()
+{
+	Scopes.resize(1);
+	Scopes.back().Totals.clear();
+	Scopes.back().NumDevices = 0;
+	Slots.clear();
+	Position = 0;
+}
+
+// A device mostly runs its tests in the same order as the one before, so the
+// event position finds the totals without hashing the test number
+ST_TSRAccumulator::Stats &ST_TSRAccumulator::
+GetStats(unsigned int test_id)
+{
+	if (Position == Slots.size()) {
+		Slot slot;
+		slot.TestID = test_id;
+		slot.Totals = &FindStats(test_id);
+		Slots.push_back(slot);
+	}
+	Slot &slot = Slots[Position++];
+	if (slot.TestID != test_id) {
+		slot.TestID = test_id;
+		slot.Totals = &FindStats(test_id);
+	}
+	return *slot.Totals;
+}
+
+ST_TSRAccumulator::Stats &ST_TSRAccumulator::
+FindStats(unsigned int test_id)
+{
+	StatsMap &totals = Scopes.back().Totals;
+	StatsMap::iterator it = totals.find(test_id);
+	if (it != totals.end())
+		return it -> second;
+	Stats &stats = totals[test_id];
+	InitStats(stats);
+	return stats;
+}
+
+// Same starting values as the TSRInfo reduction in SummaryData
+void ST_TSRAccumulator::
+InitStats(Stats &stats)
+{
+	stats.NumTested = 0;
+	stats.NumFails = 0;
+	stats.MinValue = 1e100;
+	stats.MaxValue = -1e100;
+	stats.Sums = 0.0;
+	stats.SumOfSquares = 0.0;
+	stats.HasValues = false;
+	stats.Partial = false;
+}
+
+void ST_TSRAccumulator::
+MergeStats(Stats &stats, const Stats &from)
+{
+	stats.NumTested += from.NumTested;
+	stats.NumFails += from.NumFails;
+	if (from.MinValue < stats.MinValue)
+		stats.MinValue = from.MinValue;
+	if (from.MaxValue > stats.MaxValue)
+		stats.MaxValue = from.MaxValue;
+	stats.Sums += from.Sums;
+	stats.SumOfSquares += from.SumOfSquares;
+	stats.HasValues = stats.HasValues || from.HasValues;
+	stats.Partial = stats.Partial || from.Partial;
+}
+
+void ST_TSRAccumulator::
+AddParametric(const DatalogParametric &pdata)
+{
+	Stats &stats = GetStats(pdata.GetTestID());
+	const TMResultM &Res = pdata.GetResult();
+	for (SiteIter s1 = SelectedSites.Begin(); !s1.End(); ++s1) {
+		SITE site = *s1;
+		if ((Res[site] != TM_PASS) && (Res[site] != TM_FAIL))
+			continue;
+		double value;
+		if (!GetScalarValue(pdata.GetBaseSData(DatalogParametric::Test, site), value)) {
+			stats.Partial = true;
+			continue;
+		}
+		++stats.NumTested;
+		if (Res[site] == TM_FAIL)
+			++stats.NumFails;
+		if (value < stats.MinValue)
+			stats.MinValue = value;
+		if (value > stats.MaxValue)
+			stats.MaxValue = value;
+		stats.Sums += value;
+		stats.SumOfSquares += value * value;
+		stats.HasValues = true;
+	}
+}
+
+void ST_TSRAccumulator::
+AddFunctional(unsigned int test_id, const TMResultM &res)
+{
+	Stats &stats = GetStats(test_id);
+	for (SiteIter s1 = SelectedSites.Begin(); !s1.End(); ++s1) {
+		SITE site = *s1;
+		if (res[site] == TM_PASS)
+			++stats.NumTested;
+		else if (res[site] == TM_FAIL) {
+			++stats.NumTested;
+			++stats.NumFails;
+		}
+	}
+}
+
+void ST_TSRAccumulator::
+AddPartial(unsigned int test_id)
+{
+	GetStats(test_id).Partial = true;
+}
+
+void ST_TSRAccumulator::
+EndOfDevice()
+{
+	++Scopes.back().NumDevices;
+	Position = 0;
+}
+
+void ST_TSRAccumulator::
+EndOfSummary()
+{
+	Scopes.push_back(Scope());
+	Scopes.back().NumDevices = 0;
+	Slots.clear();				// they point into the closed scope
+	Position = 0;
+}
+
+// Totals of the latest scopes that together hold exactly num_devices devices.
+// Returns false when no run of scopes matches, the summary then has no totals.
+bool ST_TSRAccumulator::
+Collect(unsigned long num_devices, StatsMap &totals) const
+{
+	totals.clear();
+	size_t first = Scopes.size();
+	unsigned long count = 0;
+	while ((first > 0) && (count < num_devices))
+		count += Scopes[--first].NumDevices;
+	if (count != num_devices)
+		return false;
+	if (first == Scopes.size() - 1) {
+		totals = Scopes.back().Totals;
+		return true;
+	}
+	for (size_t ii = first; ii < Scopes.size(); ++ii) {
+		for (StatsMap::const_iterator it = Scopes[ii].Totals.begin(); it != Scopes[ii].Totals.end(); ++it) {
+			StatsMap::iterator total = totals.find(it -> first);
+			if (total == totals.end())
+				totals.insert(*it);
+			else
+				MergeStats(total -> second, it -> second);
+		}
+	}
+	return true;
+}
+
+#ifdef ST_DATALOG_VERIFY_TSR
+// Counts must match exactly, the sums only up to the summation order
+bool ST_TSRAccumulator::
+IsSameStats(const Stats &stats1, const Stats &stats2)
+{
+	const double tolerance = 1e-9;
+	return (stats1.NumTested == stats2.NumTested) && (stats1.NumFails == stats2.NumFails) &&
+	       (stats1.MinValue == stats2.MinValue) && (stats1.MaxValue == stats2.MaxValue) &&
+	       (fabs(stats1.Sums - stats2.Sums) <= tolerance * std::max(1.0, fabs(stats2.Sums))) &&
+	       (fabs(stats1.SumOfSquares - stats2.SumOfSquares) <= tolerance * std::max(1.0, fabs(stats2.SumOfSquares)));
+}
+#endif
+
+// ***************************************************************************** 
+// ST_ParametricLines
+// The ASCII lines of one parametric event, resolved on the test thread into
+// plain data: the sites, widths, flags, scales and strings the layout needs are
+// copied out of the system and the parent, the values are referenced in the
+// prepared payload. Laying the lines out (RenderParametricLines) then only
+// reads this object and the values, so the writer thread can do it in async
+// mode. The payload does not change once prepared, and an entry that is
+// queued to the writer holds a reference to it (Prep), which is released on
+// the test thread. Objects are reused from event to event and keep their
+// capacity.
+
+class ST_ParametricLines {
+public:
+	struct Value {
+		const BasicVar *TV;
+		const BasicVar *LL;
+		const BasicVar *HL;
+		double Scale;
+		std::string Units;
+	};
+	struct SiteLine {
+		SITE Site;
+		TM_RESULT Result;
+		bool Tested;				// column mode: false leaves the column blank
+		bool First;				// column mode: the line starts before this column
+		bool Last;				// column mode: the line ends after this column
+		Value Val;
+	};
+
+	ST_ParametricLines();
+
+	ST_PreparedParametric *Prep;			// payload the values point into, async mode only
+	unsigned int TestID;
+	int FieldWidth;
+	int IntPartWidth;
+	bool Columns;
+	std::string PassString;
+	std::string PinString;
+	std::string Description;
+	Value Limits;					// column mode, from the first datalogged site
+	std::vector<SiteLine> Lines;
+	size_t NumLines;				// entries of Lines in use, the others keep their capacity
+
+	SiteLine &AddLine(SITE site);
+	void Release();
+};
+
+ST_ParametricLines::
+ST_ParametricLines() :
+	Prep(NULL),
+	TestID(0),
+	FieldWidth(0),
+	IntPartWidth(0),
+	Columns(false),
+	PassString(),
+	PinString(),
+	Description(),
+	Limits(),
+	Lines(),
+	NumLines(0)
+{
+}
+
+ST_ParametricLines::SiteLine &ST_ParametricLines::
+AddLine(SITE site)
+{
+	if (NumLines == Lines.size())
+		Lines.push_back(SiteLine());
+	SiteLine &line = Lines[NumLines++];
+	line.Site = site;
+	line.Tested = false;
+	line.First = false;
+	line.Last = false;
+	line.Val.TV = NULL;
+	line.Val.LL = NULL;
+	line.Val.HL = NULL;
+	line.Val.Scale = 1.0;
+	line.Val.Units.clear();
+	return line;
+}
+
+void ST_ParametricLines::
+Release()
+{
+	if (Prep != NULL) {
+		Prep -> Release();
+		Prep = NULL;
+	}
+	NumLines = 0;
+}
+
+static void AssignString(std::string &str, const StringS &from)
+{
+	str.assign((const char *)from, from.Length());
+}
+
+// Lays out the lines in the ASCII datalog format, see ParametricTestData
+static void RenderParametricLines(const ST_ParametricLines &lines, std::ostream &output);
+
 // ***************************************************************************** 
 // ***************************************************************************** 
 // ST_DatalogData
@@ -130,6 +1328,15 @@ public:
 	ST_DatalogData(DatalogMethod::SystemEvents event, ST_Datalog &parent);
 	virtual ~ST_DatalogData() = 0;
 
+	// Event objects live in the parent's pool: new (pool) XData(...)
+	static void *operator new(size_t size, ST_DatalogPool &pool);
+	static void operator delete(void *ptr, ST_DatalogPool &pool);
+	static void operator delete(void *ptr);
+
+	// Async mode: resolves the ASCII output into lines the writer thread lays out.
+	// False for the events that have no such form, they are formatted by Format().
+	virtual bool ResolveASCII(const char *format, bool fail_only_mode, std::ostream &output, ST_ParametricLines &lines);
+
 	// public methods for reading the members
 	bool GetSummaryBySite() const;
 	bool GetVerboseEnable() const;
@@ -149,6 +1356,7 @@ public:
 	void ResetNumTestsExecuted();
 	void IncNumTestsExecuted();
 	unsigned int GetNumTestsExecuted(SITE site) const;
+	const UnsignedM &GetNumTestsExecuted() const;
 	void SetFinishTime();
 	const FloatS &GetFinishTime() const;
 	IntS GetFieldWidth();
@@ -165,7 +1373,14 @@ protected:
 
 	void SetSummaryNeeded(bool is_needed);
         void FormatTestDescription(StringS &str, const StringS &user_desc) const;
+	const ST_DescriptionCache::Entry &FormatParametricText(unsigned int test_id, const StringS &comment, const PinML &pins,
+	                                                       bool append_pin, bool pin_string) const;
 	STDFV4Stream GetSTDFV4Stream(bool make_private) const;
+	ST_DatalogPool::Counters GetPoolCounters() const;
+	const ST_TSRAccumulator &GetTSRAccumulator() const;
+	template <class P> double CalculateUnitScale(const P &pdata, const StringS &units, StringS &real_units, bool base) const;
+	template <class P> double CalculateAutoRangeUnitScale(const P &pdata, const StringS &units, StringS &real_units,
+	                                                      const BasicVar &TV, const BasicVar &LL, const BasicVar &HL) const;
 private:
 	ST_DatalogData();				// disable default constructor
 	ST_DatalogData(const ST_DatalogData &);	// disable copy
@@ -186,6 +1401,30 @@ ST_DatalogData::
 {
 }
 
+void *ST_DatalogData::
+operator new(size_t size, ST_DatalogPool &pool)
+{
+	return pool.Allocate(size);
+}
+
+void ST_DatalogData::
+operator delete(void *ptr, ST_DatalogPool &)
+{
+	ST_DatalogPool::Free(ptr);			// only called when a constructor throws
+}
+
+void ST_DatalogData::
+operator delete(void *ptr)
+{
+	ST_DatalogPool::Free(ptr);
+}
+
+bool ST_DatalogData::
+ResolveASCII(const char *, bool, std::ostream &, ST_ParametricLines &)
+{
+	return false;
+}
+
 bool ST_DatalogData::
 GetVerboseEnable() const
 {
@@ -317,93 +1556,573 @@ GetLastFormatEvent() const
 	return (Parent != NULL) ? Parent -> LastFormatEvent : DatalogMethod::StartTestNode;
 }
 
-void ST_DatalogData::
-SetLastFormatEvent()
+void ST_DatalogData::
+SetLastFormatEvent()
+{
+	if (Parent != NULL)
+		Parent -> LastFormatEvent = Event;
+}
+
+PinML &ST_DatalogData::
+GetVerbosePins()
+{
+	if (Parent != NULL)
+		return Parent -> VerbosePins;
+	return UTL_VOID;
+}
+
+void ST_DatalogData::
+ResetNumTestsExecuted()
+{
+	if (Parent != NULL)
+		Parent -> NumTestsExecuted = 0;
+}
+
+void ST_DatalogData::
+IncNumTestsExecuted()
+{
+	if (Parent != NULL) {
+		for (SiteIter s1 = GetDlogSites().Begin(); !s1.End(); ++s1)
+			++(Parent -> NumTestsExecuted[*s1]);
+	}
+}
+
+unsigned int ST_DatalogData::
+GetNumTestsExecuted(SITE site) const
+{
+	if (Parent != NULL)
+		return Parent -> NumTestsExecuted[site];
+	return 0;
+}
+
+const UnsignedM &ST_DatalogData::
+GetNumTestsExecuted() const
+{
+	if (Parent != NULL)
+		return Parent -> NumTestsExecuted;
+	return UTL_VOID;
+}
+
+void ST_DatalogData::
+SetFinishTime()
+{
+	if (Parent != NULL)
+		Parent -> FinishTime = DlogTime;
+}
+
+const FloatS &ST_DatalogData::
+GetFinishTime() const
+{
+	if (Parent != NULL)
+		return Parent -> FinishTime;
+	return UTL_VOID;
+}
+
+STDFV4Stream ST_DatalogData::
+GetSTDFV4Stream(bool make_private) const
+{
+	if (Parent != NULL)
+		return Parent -> GetSTDFV4Stream(make_private);
+	return STDFV4Stream::NullSTDFV4Stream;
+}
+
+void ST_DatalogData::
+FormatTestDescription(StringS &str, const  StringS &user_info) const
+{
+	if (user_info.Valid() && (user_info.Length() > 0)) {
+		str = user_info;
+		return;
+	}
+	if (Parent != NULL) {
+		const StringS &TN = GetTestName();
+		if (TN.Valid() && (TN.Length() > 0)) {
+			str = TN;
+			const StringS &BN = GetBlockName();
+			if (BN.Valid() && (BN.Length() > 0)) {
+				str += "/";
+				str += BN;
+			}
+			return;
+		}
+	}
+	str = user_info;
+}
+
+// Test description, and pin string when asked for, of a parametric test from
+// the shared ST_DescriptionCache. Built on the first use in this lot.
+const ST_DescriptionCache::Entry &ST_DatalogData::
+FormatParametricText(unsigned int test_id, const StringS &comment, const PinML &pins, bool append_pin, bool pin_string) const
+{
+	const StringS &TN = GetTestName();
+	const StringS &BN = GetBlockName();
+	ST_DescriptionCache::Entry *entry = Parent -> Shared -> DescCache.Find(test_id, TN, BN, append_pin);
+	if (entry == NULL) {
+		entry = &Parent -> Shared -> DescCache.Insert(test_id, TN, BN, append_pin);
+		StringS testText = comment;
+		if (append_pin) DatalogData::AppendPinNameToTestText(pins, testText);
+		FormatTestDescription(entry -> Description, testText);
+	}
+	if (pin_string && !entry -> HasPinString) {
+		DatalogBaseUserData::FormatPins(entry -> PinString, pins, PGSize);
+		entry -> HasPinString = true;
+	}
+	return *entry;
+}
+
+int ST_DatalogData::GetIntegerPartWidth() const
+{
+    return (GetASCIIOptimizeForUnscaledValues() ? IntegerPartWidthUnscaled : IntegerPartWidthScaled);
+}
+
+ST_DatalogPool::Counters ST_DatalogData::
+GetPoolCounters() const
+{
+	return Parent -> Pool -> GetCounters();
+}
+
+// The system unit scale routines, memoized in the shared ST_UnitScaleCache.
+// real_units is resolved into a marked scratch string first so an entry also
+// remembers when the system left the caller's string untouched.
+static const char *UnresolvedUnits = "\001";
+
+template <class P> double ST_DatalogData::
+CalculateUnitScale(const P &pdata, const StringS &units, StringS &real_units, bool base) const
+{
+	const unsigned int test_id = pdata.GetTestID();
+	const ST_UnitScaleCache::Kind kind = base ? ST_UnitScaleCache::BASE_UNIT_SCALE : ST_UnitScaleCache::UNIT_SCALE;
+	double scale;
+	if (Parent -> Shared -> ScaleCache.Find(test_id, kind, units, NULL, scale, real_units))
+		return scale;
+	StringS resolved = UnresolvedUnits;
+	scale = base ? pdata.CalculateBaseUnitScale(units, resolved) : pdata.CalculateUnitScale(units, resolved);
+	const bool set_units = (strcmp((const char *)resolved, UnresolvedUnits) != 0);
+	if (set_units)
+		real_units = resolved;
+	Parent -> Shared -> ScaleCache.Insert(test_id, kind, units, NULL, scale, resolved, set_units);
+	return scale;
+}
+
+template <class P> double ST_DatalogData::
+CalculateAutoRangeUnitScale(const P &pdata, const StringS &units, StringS &real_units,
+                            const BasicVar &TV, const BasicVar &LL, const BasicVar &HL) const
+{
+	// Fewest fraction digits any layout prints: the row layout puts the units,
+	// a prefix at most longer than the given ones, into the value field
+	const int field_width = (Parent != NULL) ? Parent -> FieldWidth : DefaultFieldWidth;
+	const double edge_band = ST_UnitScaleCache::GetEdgeBand(field_width - (units.Length() + 1) - GetIntegerPartWidth() - 1);
+	ST_UnitScaleCache::Bucket buckets[ST_UnitScaleCache::NumBuckets];
+	if (!ST_UnitScaleCache::GetBucket(TV, edge_band, buckets[0]) || !ST_UnitScaleCache::GetBucket(LL, edge_band, buckets[1]) ||
+	    !ST_UnitScaleCache::GetBucket(HL, edge_band, buckets[2]))
+		return pdata.CalculateAutoRangeUnitScale(units, real_units, TV, LL, HL);
+	const unsigned int test_id = pdata.GetTestID();
+	double scale;
+	if (Parent -> Shared -> ScaleCache.Find(test_id, ST_UnitScaleCache::AUTO_RANGE_SCALE, units, buckets, scale, real_units))
+		return scale;
+	StringS resolved = UnresolvedUnits;
+	scale = pdata.CalculateAutoRangeUnitScale(units, resolved, TV, LL, HL);
+	const bool set_units = (strcmp((const char *)resolved, UnresolvedUnits) != 0);
+	if (set_units)
+		real_units = resolved;
+	Parent -> Shared -> ScaleCache.Insert(test_id, ST_UnitScaleCache::AUTO_RANGE_SCALE, units, buckets, scale, resolved, set_units);
+	return scale;
+}
+
+const ST_TSRAccumulator &ST_DatalogData::
+GetTSRAccumulator() const
+{
+	return *Parent -> TSRAccum;
+}
+
+// ***************************************************************************** 
+// ST_DatalogWriter
+// Background writer used when the AsyncFormatting attribute is enabled.
+// Events are handed to the writer thread in order through a bounded
+// single-producer / single-consumer ring. Parametric events, the bulk of the
+// ASCII datalog, are only resolved on the test thread (ST_ParametricLines);
+// the writer thread lays their lines out into a buffer it owns and writes
+// them. The other events read system state (lot info, bin counts, the STDFv4
+// stream) while they format, so their Format() still runs on the test thread,
+// into the buffer of the ring entry, and the writer thread only writes it.
+// The writer thread calls no Unison routine but DatalogBaseUserData::
+// FormatSVData on the values of a prepared payload; it does not copy or
+// destroy Unison objects, the payloads are released on the test thread when
+// their entries are recycled (Reclaim).
+// Stream ownership: the output stream stays the system's, but between two
+// flush barriers only the writer thread writes to it; the test thread only
+// reads its formatting state. Flush() returns once everything queued has been
+// written. It is called before every Summary, at EndOfLot and ProgramUnload,
+// before any event formatted synchronously, when the system hands over a
+// different stream and before the writer is destroyed, so a stream is never
+// closed or reused by the system while the writer still writes to it.
+// Both threads block on a condition variable when they have to wait. Write
+// failures on the writer thread are reported on the test thread.
+
+class ST_DatalogWriter {
+public:
+	ST_DatalogWriter();
+	~ST_DatalogWriter();
+
+	void Format(ST_DatalogData &data, const char *format, bool fail_only_mode, std::ostream &output);
+	void Flush();
+	void Reclaim();
+private:
+	struct Entry {
+		std::string Text;			// formatted on the test thread, keeps its capacity between events
+		ST_ParametricLines Lines;		// laid out by the writer thread when HasLines is set
+		bool HasLines;
+		std::ostream *Output;
+	};
+	// Appends everything written to Text to the entry being filled
+	class TextBuffer : public std::streambuf {
+	public:
+		TextBuffer() : Target(NULL) {}
+		void SetTarget(std::string *target) { Target = target; }
+	protected:
+		virtual std::streamsize xsputn(const char *s, std::streamsize n) { Target -> append(s, n); return n; }
+		virtual int_type overflow(int_type c)
+		{
+			if (!traits_type::eq_int_type(c, traits_type::eof()))
+				Target -> push_back(traits_type::to_char_type(c));
+			return traits_type::not_eof(c);
+		}
+	private:
+		std::string *Target;
+	};
+	static const unsigned long QueueSize = 4096;	// must be a power of 2
+
+	std::vector<Entry> Queue;
+	std::atomic<unsigned long> Head;		// next free entry, only written by the test thread
+	std::atomic<unsigned long> Tail;		// next entry to write, only written by the writer thread
+	unsigned long Reclaimed;			// entries before this one hold no payload, test thread only
+	std::atomic<bool> Stop;
+	std::atomic<bool> WriterWaiting;		// the writer thread waits for an entry
+	std::atomic<bool> TestWaiting;			// the test thread waits for the writer to free entries
+	std::mutex WaitLock;				// only taken to wait or to wake the other side
+	std::condition_variable EntryQueued;
+	std::condition_variable EntryWritten;
+	TextBuffer Buffer;
+	std::ostream Text;				// formats into Buffer, only used by the test thread
+	std::ostream *TextOutput;			// stream whose formatting state Text carries
+	std::ios_base::fmtflags OutputFlags;		// formatting state of TextOutput when it was copied
+	std::streamsize OutputPrecision;
+	std::streamsize OutputWidth;
+	char OutputFill;
+	std::string Lines;				// parametric lines, only used by the writer thread
+	TextBuffer LinesBuffer;
+	std::ostream LinesText;				// formats into LinesBuffer, only used by the writer thread
+	std::atomic<unsigned long> Failures;		// failed writes not yet reported
+	std::mutex FailureLock;
+	std::string FailureReason;			// first failure not yet reported
+	bool Reported;					// a failure was reported since the last Flush()
+	std::thread Thread;
+
+	void CopyFormat(std::ostream &output);
+	void WaitForWriter(unsigned long tail);
+	void Run();
+	void Fail(const char *reason);
+	void ReportFailures();
+
+	ST_DatalogWriter(const ST_DatalogWriter &);		// disable copy
+	ST_DatalogWriter &operator=(const ST_DatalogWriter &);	// disable copy
+};
+
+ST_DatalogWriter::
+ST_DatalogWriter() :
+	Queue(QueueSize),
+	Head(0),
+	Tail(0),
+	Reclaimed(0),
+	Stop(false),
+	WriterWaiting(false),
+	TestWaiting(false),
+	WaitLock(),
+	EntryQueued(),
+	EntryWritten(),
+	Buffer(),
+	Text(&Buffer),
+	TextOutput(NULL),
+	OutputFlags(),
+	OutputPrecision(0),
+	OutputWidth(0),
+	OutputFill(' '),
+	Lines(),
+	LinesBuffer(),
+	LinesText(&LinesBuffer),
+	Failures(0),
+	FailureLock(),
+	FailureReason(),
+	Reported(false),
+	Thread()
+{
+	LinesBuffer.SetTarget(&Lines);
+	Thread = std::thread(&ST_DatalogWriter::Run, this);
+}
+
+ST_DatalogWriter::
+~ST_DatalogWriter()
+{
+	Flush();
+	{
+		std::lock_guard<std::mutex> lock(WaitLock);
+		Stop = true;
+		EntryQueued.notify_one();
+	}
+	if (Thread.joinable())
+		Thread.join();
+}
+
+void ST_DatalogWriter::
+Format(ST_DatalogData &data, const char *format, bool fail_only_mode, std::ostream &output)
+{
+	// The system handed over another stream, the writer has to be done with the last one
+	if ((TextOutput != NULL) && (TextOutput != &output))
+		Flush();
+	const unsigned long head = Head.load(std::memory_order_relaxed);
+	// Back-pressure: the ring is bounded, wait for the writer to free an entry
+	if ((head - Tail.load()) >= QueueSize)
+		WaitForWriter(head - QueueSize + 1);
+	Reclaim();
+	Entry &entry = Queue[head & (QueueSize - 1)];
+	entry.Text.clear();
+	Buffer.SetTarget(&entry.Text);
+	CopyFormat(output);
+	// Runs on the test thread, exceptions reach the caller as in synchronous mode
+	entry.HasLines = data.ResolveASCII(format, fail_only_mode, Text, entry.Lines);
+	if (!entry.HasLines)
+		data.Format(format, fail_only_mode, Text);
+	if (entry.HasLines || !entry.Text.empty()) {
+		entry.Output = &output;
+		Head.store(head + 1);
+		if (WriterWaiting.load()) {
+			std::lock_guard<std::mutex> lock(WaitLock);
+			EntryQueued.notify_one();
+		}
+	}
+	// A failed stream fails every write, report it once and the count at the next Flush()
+	if (!Reported)
+		ReportFailures();
+}
+
+// Text carries the formatting state of the output. A new stream is copied
+// whole. Afterwards the width, precision, fill and flags of the output are
+// compared on every event, and whatever the system changed since the last
+// event is applied to Text on top of the state the previous events left, as
+// it would be applied to the output in synchronous mode.
+void ST_DatalogWriter::
+CopyFormat(std::ostream &output)
+{
+	if (TextOutput != &output) {
+		Text.copyfmt(output);
+		Text.clear();
+		TextOutput = &output;
+	}
+	else {
+		const std::ios_base::fmtflags changed = output.flags() ^ OutputFlags;
+		if (changed != 0)
+			Text.flags((Text.flags() & ~changed) | (output.flags() & changed));
+		if (output.precision() != OutputPrecision)
+			Text.precision(output.precision());
+		if (output.width() != OutputWidth)
+			Text.width(output.width());
+		if (output.fill() != OutputFill)
+			Text.fill(output.fill());
+	}
+	OutputFlags = output.flags();
+	OutputPrecision = output.precision();
+	OutputWidth = output.width();
+	OutputFill = output.fill();
+}
+
+void ST_DatalogWriter::
+Flush()
+{
+	const unsigned long head = Head.load(std::memory_order_relaxed);
+	if (Tail.load() != head)
+		WaitForWriter(head);
+	Reclaim();
+	ReportFailures();
+	Reported = false;
+}
+
+// Releases the payloads of the entries the writer thread is done with. Test thread only.
+void ST_DatalogWriter::
+Reclaim()
+{
+	const unsigned long tail = Tail.load();
+	for (; Reclaimed != tail; ++Reclaimed)
+		Queue[Reclaimed & (QueueSize - 1)].Lines.Release();
+}
+
+// Blocks the test thread until the writer thread has written every entry before tail
+void ST_DatalogWriter::
+WaitForWriter(unsigned long tail)
+{
+	std::unique_lock<std::mutex> lock(WaitLock);
+	TestWaiting = true;
+	while (Tail.load() < tail)
+		EntryWritten.wait(lock);
+	TestWaiting = false;
+}
+
+void ST_DatalogWriter::
+Run()
+{
+	for (;;) {
+		const unsigned long tail = Tail.load(std::memory_order_relaxed);
+		if (tail == Head.load()) {
+			std::unique_lock<std::mutex> lock(WaitLock);
+			WriterWaiting = true;
+			while ((tail == Head.load()) && !Stop.load())
+				EntryQueued.wait(lock);
+			WriterWaiting = false;
+			if (tail == Head.load())
+				break;				// stopped, and everything was written
+			continue;
+		}
+		Entry &entry = Queue[tail & (QueueSize - 1)];
+		try {
+			if (!entry.Text.empty())
+				entry.Output -> write(entry.Text.data(), entry.Text.size());
+			if (entry.HasLines) {
+				Lines.clear();
+				RenderParametricLines(entry.Lines, LinesText);
+				entry.Output -> write(Lines.data(), Lines.size());
+			}
+			// Flushed once the ring runs empty, before Tail moves on: past a
+			// flush barrier the test thread may use the stream again
+			if (tail + 1 == Head.load())
+				entry.Output -> flush();
+			if (!*entry.Output)
+				Fail("output stream is in a failed state");
+		}
+		catch (const std::exception &e) {
+			Fail(e.what());
+		}
+		catch (...) {
+			Fail("unknown exception");
+		}
+		Tail.store(tail + 1);
+		if (TestWaiting.load()) {
+			std::lock_guard<std::mutex> lock(WaitLock);
+			EntryWritten.notify_one();
+		}
+	}
+}
+
+void ST_DatalogWriter::
+Fail(const char *reason)
+{
+	std::lock_guard<std::mutex> lock(FailureLock);
+	if (Failures.load() == 0)
+		FailureReason = (reason != NULL) ? reason : "";
+	Failures.fetch_add(1);
+}
+
+void ST_DatalogWriter::
+ReportFailures()
 {
-	if (Parent != NULL)
-		Parent -> LastFormatEvent = Event;
+	if (Failures.load(std::memory_order_relaxed) == 0)
+		return;
+	std::string reason;
+	unsigned long count = 0;
+	{
+		std::lock_guard<std::mutex> lock(FailureLock);
+		count = Failures.exchange(0);
+		reason.swap(FailureReason);
+	}
+	Reported = true;
+	std::cout << "<ST_DatalogWriter> " << count << " datalog write(s) failed on the writer thread: "
+	          << reason << std::endl;
 }
 
-PinML &ST_DatalogData::
-GetVerbosePins()
+// The object returned to the system in async mode. It owns the collected
+// event, formats it into the writer ring and is deleted by the system as soon
+// as Format() returns.
+class ST_AsyncDatalogData : public DatalogData {
+public:
+	ST_AsyncDatalogData(ST_DatalogWriter &writer, ST_DatalogData *data);
+	~ST_AsyncDatalogData();
+
+	static void *operator new(size_t size, ST_DatalogPool &pool);
+	static void operator delete(void *ptr, ST_DatalogPool &pool);
+	static void operator delete(void *ptr);
+
+	virtual void Format(const char *format, bool fail_only_mode, std::ostream &output);
+private:
+	ST_DatalogWriter *Writer;
+	ST_DatalogData *Data;
+
+	ST_AsyncDatalogData(const ST_AsyncDatalogData &);		// disable copy
+	ST_AsyncDatalogData &operator=(const ST_AsyncDatalogData &);	// disable copy
+};
+
+ST_AsyncDatalogData::
+ST_AsyncDatalogData(ST_DatalogWriter &writer, ST_DatalogData *data) :
+	DatalogData(),
+	Writer(&writer),
+	Data(data)
 {
-	if (Parent != NULL)
-		return Parent -> VerbosePins;
-	return UTL_VOID;
 }
 
-void ST_DatalogData::
-ResetNumTestsExecuted()
+ST_AsyncDatalogData::
+~ST_AsyncDatalogData()
 {
-	if (Parent != NULL)
-		Parent -> NumTestsExecuted = 0;
+	delete Data;
 }
 
-void ST_DatalogData::
-IncNumTestsExecuted()
+void *ST_AsyncDatalogData::
+operator new(size_t size, ST_DatalogPool &pool)
 {
-	if (Parent != NULL) {
-		for (SiteIter s1 = GetDlogSites().Begin(); !s1.End(); ++s1)
-			++(Parent -> NumTestsExecuted[*s1]);
-	}
+	return pool.Allocate(size);
 }
 
-unsigned int ST_DatalogData::
-GetNumTestsExecuted(SITE site) const
+void ST_AsyncDatalogData::
+operator delete(void *ptr, ST_DatalogPool &)
 {
-	if (Parent != NULL)
-		return Parent -> NumTestsExecuted[site];
-	return 0;
+	ST_DatalogPool::Free(ptr);
 }
 
-void ST_DatalogData::
-SetFinishTime()
+void ST_AsyncDatalogData::
+operator delete(void *ptr)
 {
-	if (Parent != NULL)
-		Parent -> FinishTime = DlogTime;
+	ST_DatalogPool::Free(ptr);
 }
 
-const FloatS &ST_DatalogData::
-GetFinishTime() const
+void ST_AsyncDatalogData::
+Format(const char *format, bool fail_only_mode, std::ostream &output)
 {
-	if (Parent != NULL)
-		return Parent -> FinishTime;
-	return UTL_VOID;
+	Writer -> Format(*Data, format, fail_only_mode, output);
 }
 
-STDFV4Stream ST_DatalogData::
-GetSTDFV4Stream(bool make_private) const
+ST_Datalog::
+~ST_Datalog()
 {
-	if (Parent != NULL)
-		return Parent -> GetSTDFV4Stream(make_private);
-	return STDFV4Stream::NullSTDFV4Stream;
+	delete Writer;			// drains the ring before joining the writer thread
+	Shared -> Release();
+	delete TSRAccum;
+	Pool -> Release();		// freed now, or with the last event object the system still holds
 }
 
-void ST_DatalogData::
-FormatTestDescription(StringS &str, const  StringS &user_info) const
-{
-	if (user_info.Valid() && (user_info.Length() > 0)) {
-		str = user_info;
-		return;
-	}
-	if (Parent != NULL) {
-		const StringS &TN = GetTestName();
-		if (TN.Valid() && (TN.Length() > 0)) {
-			str = TN;
-			const StringS &BN = GetBlockName();
-			if (BN.Valid() && (BN.Length() > 0)) {
-				str += "/";
-				str += BN;
-			}
-			return;
-		}
+DatalogData *ST_Datalog::
+Dispatch(ST_DatalogData *data)
+{
+	if (data == NULL)
+		return NULL;
+	if (AsyncFormatting.GetValue()) {
+		if (Writer == NULL)
+			Writer = new ST_DatalogWriter();
+		return new (*Pool) ST_AsyncDatalogData(*Writer, data);
 	}
-	str = user_info;
+	// Synchronous formatting must not overtake anything still queued
+	FlushWriter();
+	return data;
 }
 
-int ST_DatalogData::GetIntegerPartWidth() const
+void ST_Datalog::
+FlushWriter()
 {
-    return (GetASCIIOptimizeForUnscaledValues() ? IntegerPartWidthUnscaled : IntegerPartWidthScaled);
+	if (Writer != NULL)
+		Writer -> Flush();
 }
 
 // ***************************************************************************** 
@@ -481,7 +2200,15 @@ DatalogData *ST_Datalog::
 StartOfTest(const DatalogBaseUserData *)
 {
 	SummaryNeeded = true;
-	return new StartOfTestData(*this);
+	// The previous device ended with its EndOfTest object, which the system
+	// has formatted and deleted by now, so this is where its window closes.
+	if (Writer != NULL)
+		Writer -> Reclaim();		// payloads the writer thread is done with
+	Pool -> EndOfDevice();
+	Shared -> ScaleCache.SetLimitTable(TestProg.GetActiveLimitTable().GetName());
+	++DeviceCount;
+	EventIndex = 0;
+	return Dispatch(new (*Pool) StartOfTestData(*this));
 }
 
 // ***************************************************************************** 
@@ -497,6 +2224,8 @@ private:
 	EndOfTestStruct EOT;
 	bool Valid;
 	Sites SelSites;
+	ST_SiteSet SelSet;				// SelSites for membership tests and iteration
+	UnsignedM TestsExecuted;			// snapshot, the next StartOfTest resets the parent counter
 	void FormatASCII(bool fail_only_mode, std::ostream &output);
 	void FormatSTDFV4(bool fail_only_mode, std::ostream &output);
 };
@@ -506,7 +2235,9 @@ EndOfTestData(ST_Datalog &parent) :
 	ST_DatalogData(DatalogMethod::EndOfTest, parent),
 	Valid(false),
 	EOT(),
-	SelSites(SelectedSites)
+	SelSites(SelectedSites),
+	SelSet(SelSites),
+	TestsExecuted(GetNumTestsExecuted())
 {
 	Valid = RunTime.GetEndOfTestData(EOT);
 	SetFinishTime();
@@ -529,15 +2260,6 @@ Format(const char *format, bool fail_only_mode, std::ostream &output)
 	}
 }
 
-static bool IsSelectedSite(SITE site)
-// Checks to see if the site passed in is in the SelectedSites list for this run
-{
-	for (SiteIter s1 = SelectedSites.Begin(); !s1.End(); ++s1) {
-		if (*s1 == site) return true;
-	}
-	return false;
-}
-
 static void OutputBorder(std::ostream &output, int len, int space)
 {
 	char buff[1024];
@@ -583,7 +2305,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 		output << setw(12+field_width) << left << " Pass/Fail" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
 			StringS PF = " ";
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				PF = (EOT.Results[*s1] == true) ? "PASS " : "*FAIL*";
 			}
 			output << setw(field_width+3) << right << PF << setw(3) << " ";
@@ -592,7 +2314,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 		output << setw(12+field_width) << left << " Bin Name" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				StringS bin_text = EOT.BinNames[*s1];
 				output << setw(field_width+4) << left << bin_text.Substring(0,field_width+4) << setw(2) << " ";
 			} else
@@ -602,17 +2324,17 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 		output << setw(12+field_width) << left << " Serial Number" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				output << setw(field_width+2) << right << EOT.SerialNumbers[*s1] << setw(4) << " ";
 			} else
 				output << setw(field_width+4) << " " << setw(2) << " ";
 		}
 		output << endl;
 
-		if (EOT.XCoord[SelectedSites.Begin().GetValue()] > UTL_NO_WAFER_COORD) {
+		if (EOT.XCoord[SelSites.Begin().GetValue()] > UTL_NO_WAFER_COORD) {
 			output << setw(12+field_width) << left << " Wafer X-Coordinate" << setw(2) << " ";
 			for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-				if (IsSelectedSite(*s1)) {
+				if (SelSet.Contains(*s1)) {
 					output << setw(field_width+2) << right << EOT.XCoord[*s1] << setw(4) << " ";
 				} else
 					output << setw(field_width+4) << " " << setw(2) << " ";
@@ -621,7 +2343,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 			output << setw(12+field_width) << left << " Wafer Y-coordinate" << setw(2) << " ";
 			for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-				if (IsSelectedSite(*s1)) {
+				if (SelSet.Contains(*s1)) {
 					output << setw(field_width+2) << right << EOT.YCoord[*s1] << setw(4) << " ";
 				} else
 					output << setw(field_width+4) << " " << setw(2) << " ";
@@ -631,7 +2353,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 		output << setw(12+field_width) << left << " Software Bin Number" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				int sw_bin = EOT.SoftwareBinNumbers[*s1];
 				if (sw_bin < 0)
 					output << setw(field_width+2) << right << "Not Binned" << setw(4) << " ";
@@ -644,7 +2366,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 		output << setw(12+field_width) << left << " Hardware Bin Number" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				output << setw(field_width+2) << right << EOT.HardwareBinNumbers[*s1] << setw(4) << " ";
 			} else
 				output << setw(field_width+4) << " " << setw(2) << " ";
@@ -653,7 +2375,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 		output << setw(12+field_width) << left << " Test Time" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				output << setw(field_width+1) << fixed << setprecision(6) << right << EOT.TestTimes[*s1] << "s" << setw(4) << " ";
 			} else
 				output << setw(field_width+4) << " " << setw(2) << " ";
@@ -661,8 +2383,8 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 		output << endl;
 		output << setw(12+field_width) << left << " Total Tests Executed" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
-				output << setw(field_width+2) << right << GetNumTestsExecuted(*s1) << setw(4) << " ";
+			if (SelSet.Contains(*s1)) {
+				output << setw(field_width+2) << right << TestsExecuted[*s1] << setw(4) << " ";
 			} else
 				output << setw(field_width+4) << " " << setw(2) << " ";
 		}
@@ -670,7 +2392,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 		output << setw(12+field_width) << left << " Part Description" << setw(2) << " ";
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-			if (IsSelectedSite(*s1)) {
+			if (SelSet.Contains(*s1)) {
 				StringS part_text = EOT.PartTexts[*s1];
 				output << setw(field_width+4) << left << part_text.Substring(0,field_width+4) << setw(2) << " ";
 			} else
@@ -690,7 +2412,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 		output << endl;
 		output << "  Site  Device ID       X Coord  Y Coord   P/F  SW Bin No.  HW Bin No.  Test Time      Test Count  Status  Device Description" << endl;
 		output << "  ----  ---------       -------  -------   ---  ----------  ----------  -------------  ----------  ------  ------------------" << endl;
-		for (SiteIter s1 = SelSites.Begin(); !s1.End(); ++s1) {
+		for (ST_SiteSet::Iter s1 = SelSet.Begin(); !s1.End(); ++s1) {
 			output << "  " << fixed << setw(4) << right << *s1 << "  " << setw(9) << EOT.SerialNumbers[*s1] << "       ";
 			if (EOT.XCoord[*s1] > UTL_NO_WAFER_COORD)
 				output << fixed << setw(7) << right << EOT.XCoord[*s1] << "  " << setw(7) << right << EOT.YCoord[*s1] << "   ";
@@ -707,7 +2429,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 				output << setw(12) << fixed << setprecision(6) << right << EOT.TestTimes[*s1] << "s" << "  ";
 			else
 				output << setw(10) << right << " " << "  ";
-			output << fixed << setw(10) << right << GetNumTestsExecuted(*s1) << "  ";
+			output << fixed << setw(10) << right << TestsExecuted[*s1] << "  ";
 			if (EOT.Retest)
 				output << "RETEST";
 			else
@@ -724,9 +2446,9 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 	if (STDF.Valid()) {
 	 	STDFV4_PRR PRR;
 		StringS SNStr;
-		for (SiteIter s1 = SelSites.Begin(); !s1.End(); ++s1) {
+		for (ST_SiteSet::Iter s1 = SelSet.Begin(); !s1.End(); ++s1) {
 			PRR.SetResult(EOT.Results[*s1] == UTL_VOID ? false : true, EOT.Results[*s1], EOT.Retest ? STDFV4_PRR::REPLACE : STDFV4_PRR::NEW_PART, *s1);
-			PRR.SetInfo(EOT.OverallTestTime, GetNumTestsExecuted(*s1), EOT.HardwareBinNumbers[*s1], EOT.SoftwareBinNumbers[*s1],
+			PRR.SetInfo(EOT.OverallTestTime, TestsExecuted[*s1], EOT.HardwareBinNumbers[*s1], EOT.SoftwareBinNumbers[*s1],
 	                            EOT.SerialNumbers[*s1].GetText(), EOT.PartTexts[*s1], EOT.XCoord[*s1], EOT.YCoord[*s1]);
 			STDF.Write(PRR);
 		}
@@ -737,7 +2459,9 @@ DatalogData *ST_Datalog::
 EndOfTest(const DatalogBaseUserData *)
 {
 	SummaryNeeded = true;
-	return new EndOfTestData(*this);
+	TSRAccum -> EndOfDevice();
+	Shared -> EndOfDevice();
+	return Dispatch(new (*Pool) EndOfTestData(*this));
 }
 
 // ***************************************************************************** 
@@ -755,6 +2479,7 @@ ProgramLoad(const DatalogBaseUserData *)
 DatalogData *ST_Datalog::
 ProgramUnload(const DatalogBaseUserData *)
 {
+	FlushWriter();
 	if (SummaryNeeded)		// insure my summary has been processed
 		DoAction(GetSystemEventName(DatalogMethod::Summary));
 	return NULL;
@@ -773,6 +2498,7 @@ private:
 	EndOfTestStruct EOT;
 	bool Valid;
 	Sites SelSites;
+	UnsignedM TestsExecuted;			// snapshot, the next StartOfTest resets the parent counter
 	void FormatASCII(bool fail_only_mode, std::ostream &output);
 	void FormatSTDFV4(bool fail_only_mode, std::ostream &output);
 };
@@ -782,7 +2508,8 @@ ProgramResetData(ST_Datalog &parent) :
 	ST_DatalogData(DatalogMethod::ProgramReset, parent),
 	Valid(false),
 	EOT(),
-	SelSites(SelectedSites)
+	SelSites(SelectedSites),
+	TestsExecuted(GetNumTestsExecuted())
 {
 	Valid = RunTime.GetEndOfTestData(EOT);
 	SetFinishTime();
@@ -825,7 +2552,7 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 			output << PF << "  " << fixed << setw(10) << right << EOT.SoftwareBinNumbers[*s1] << "  " << setw(10) << right << EOT.HardwareBinNumbers[*s1] << "  ";
 		else
 			output << PF << "              " << fixed << setw(10) << right << EOT.HardwareBinNumbers[*s1] << "  ";
-		output << fixed << setw(10) << right << GetNumTestsExecuted(*s1) << "  ";
+		output << fixed << setw(10) << right << TestsExecuted[*s1] << "  ";
 		if (EOT.Retest)
 			output << "RETEST";
 		else
@@ -844,7 +2571,7 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 		for (SiteIter s1 = SelSites.Begin(); !s1.End(); ++s1) {
 			// force bad result
 			PRR.SetResult(false, EOT.Results[*s1], EOT.Retest ? STDFV4_PRR::REPLACE : STDFV4_PRR::NEW_PART, *s1);
-			PRR.SetInfo(	EOT.TestTimes[*s1], GetNumTestsExecuted(*s1), EOT.HardwareBinNumbers[*s1], EOT.SoftwareBinNumbers[*s1],
+			PRR.SetInfo(	EOT.TestTimes[*s1], TestsExecuted[*s1], EOT.HardwareBinNumbers[*s1], EOT.SoftwareBinNumbers[*s1],
 					EOT.SerialNumbers[*s1].GetText(), EOT.PartTexts[*s1], EOT.XCoord[*s1], EOT.YCoord[*s1]);
 			STDF.Write(PRR);
 		}
@@ -855,7 +2582,8 @@ DatalogData *ST_Datalog::
 ProgramReset(const DatalogBaseUserData *)
 {
 	SummaryNeeded = true;
-	return new ProgramResetData(*this);
+	Shared -> ScaleCache.Clear();
+	return Dispatch(new (*Pool) ProgramResetData(*this));
 }
 
 // ***************************************************************************** 
@@ -905,7 +2633,13 @@ private:
 	BinCountStruct Passes;
 	BinCountStruct Fails;
 	TSRInfoStruct TSRInfo;
+	std::vector<ST_TSRAccumulator::Stats> TSRTotals;	// per TSRInfo record, from the running totals
+	std::vector<bool> TSRTotalsValid;
+	int TSRTotalsUsed;
+	ST_DatalogPool::Counters PoolCounters;
 	
+	void CollectTSRTotals();
+	void ReduceTSRRecord(int rec, ST_TSRAccumulator::Stats &stats) const;
 
 	void FormatASCII(bool fail_only_mode, std::ostream &output);
 	void FormatSTDFV4(bool fail_only_mode, std::ostream &output);
@@ -944,7 +2678,10 @@ SummaryData(ST_Datalog &parent, bool is_final, bool file_closing_after_summary)
 	CurGMTime(),
 	PHName(),
 	SumHdr(),
-	TestMode()
+	TestMode(),
+	TSRTotals(),
+	TSRTotalsValid(),
+	TSRTotalsUsed(0)
 {
 	Valid = RunTime.GetBinInfo(BinInfo, Passes, Fails);
  	if (Valid) {
@@ -978,6 +2715,89 @@ SummaryData(ST_Datalog &parent, bool is_final, bool file_closing_after_summary)
 	}
  	RunTime.GetTSRInformation(TSRInfo);
 	TSRValid = (TSRInfo.TestNum.GetSize() > 0) ? true : false;
+	CollectTSRTotals();
+	PoolCounters = GetPoolCounters();
+}
+
+// Picks up the running TSR totals for every TSRInfo record they can stand in
+// for, so the all-site records do not walk the sites. Records without totals
+// fall back to ReduceTSRRecord.
+void SummaryData::
+CollectTSRTotals()
+{
+	if (!TSRValid)
+		return;
+	const unsigned long num_devices = (IsFinalSummary) ? (Passes.FinalCount + Fails.FinalCount) : (Passes.Count + Fails.Count);
+	ST_TSRAccumulator::StatsMap totals;
+	if (!GetTSRAccumulator().Collect(num_devices, totals))
+		return;					// some devices were not seen by this instance
+	int num_recs = TSRInfo.TestNum.GetSize();
+	std::unordered_map<unsigned int, int> num_uses;
+	for (int ii = 0; ii < num_recs; ii++)
+		++num_uses[(unsigned int)TSRInfo.TestNum[ii]];
+	TSRTotals.resize(num_recs);
+	TSRTotalsValid.assign(num_recs, false);
+	for (int ii = 0; ii < num_recs; ii++) {
+		ST_TSRAccumulator::StatsMap::const_iterator it = totals.find((unsigned int)TSRInfo.TestNum[ii]);
+		// A test number shared by several records can not be told apart
+		if ((it == totals.end()) || it -> second.Partial || (num_uses[(unsigned int)TSRInfo.TestNum[ii]] != 1))
+			continue;
+		TSRTotals[ii] = it -> second;
+		TSRTotalsValid[ii] = true;
+		++TSRTotalsUsed;
+	}
+#ifdef ST_DATALOG_VERIFY_TSR
+	int mismatches = 0;
+	for (int ii = 0; ii < num_recs; ii++) {
+		if (!TSRTotalsValid[ii])
+			continue;
+		ST_TSRAccumulator::Stats reduced;
+		ReduceTSRRecord(ii, reduced);
+		reduced.HasValues = TSRTotals[ii].HasValues;
+		reduced.Partial = false;
+		if (!TSRTotals[ii].HasValues) {
+			reduced.MinValue = TSRTotals[ii].MinValue;	// functional, only the counts are used
+			reduced.MaxValue = TSRTotals[ii].MaxValue;
+			reduced.Sums = TSRTotals[ii].Sums;
+			reduced.SumOfSquares = TSRTotals[ii].SumOfSquares;
+		}
+		if (!ST_TSRAccumulator::IsSameStats(TSRTotals[ii], reduced)) {
+			std::cout << "<SummaryData::CollectTSRTotals> test " << TSRInfo.TestNum[ii] << ": running totals "
+			          << TSRTotals[ii].NumTested << "/" << TSRTotals[ii].NumFails << ", TSRInfo "
+			          << reduced.NumTested << "/" << reduced.NumFails << std::endl;
+			TSRTotalsValid[ii] = false;
+			--TSRTotalsUsed;
+			++mismatches;
+		}
+	}
+	std::cout << "<SummaryData::CollectTSRTotals> " << TSRTotalsUsed << " TSR record(s) verified, "
+	          << mismatches << " did not match TSRInfo" << std::endl;
+#endif
+}
+
+// All-site totals of one TSRInfo record
+void SummaryData::
+ReduceTSRRecord(int rec, ST_TSRAccumulator::Stats &stats) const
+{
+	stats.NumTested = 0;
+	stats.NumFails = 0;
+	stats.MinValue = 1e100;
+	stats.MaxValue = -1e100;
+	stats.Sums = 0.0;
+	stats.SumOfSquares = 0.0;
+	for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
+		SITE site = *s1;
+		if (TSRInfo.NumTested[site][rec] > 0) {
+			stats.NumTested += TSRInfo.NumTested[site][rec];
+			stats.NumFails += TSRInfo.NumFails[site][rec];
+			if (TSRInfo.MinValue[site][rec] < stats.MinValue)
+				stats.MinValue = TSRInfo.MinValue[site][rec];
+			if (TSRInfo.MaxValue[site][rec] > stats.MaxValue)
+				stats.MaxValue = TSRInfo.MaxValue[site][rec];
+			stats.Sums += TSRInfo.Sums[site][rec];
+			stats.SumOfSquares += TSRInfo.SumOfSquares[site][rec];
+		}
+	}
 }
 
 SummaryData::
@@ -1072,12 +2892,15 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 		for (ii = 0; ii < num_recs; ii++) {
 			unsigned int NTested = 0;
 			unsigned int NFails = 0;
-			SITE first_site = NO_SITES;
-			for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
-				if (first_site == NO_SITES)
-					first_site = *s1;
-				NTested += TSRInfo.NumTested[*s1][ii];
-				NFails += TSRInfo.NumFails[*s1][ii];
+			if ((ii < (int)TSRTotalsValid.size()) && TSRTotalsValid[ii]) {
+				NTested = TSRTotals[ii].NumTested;
+				NFails = TSRTotals[ii].NumFails;
+			}
+			else {
+				for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
+					NTested += TSRInfo.NumTested[*s1][ii];
+					NFails += TSRInfo.NumFails[*s1][ii];
+				}
 			}
 			output << setw(TNSize) << right << dec << TSRInfo.TestNum[ii] << "  ";
 			output << setw(4) << right << "All" << "  ";
@@ -1217,6 +3040,17 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 	int npass = (IsFinalSummary) ? Passes.FinalCount : Passes.Count;
 	double PP = ((total > 0) && (npass > 0)) ? (double(npass) / double(total)) * 100.0 : 0.0;
 	output << " ALL  " << right << setw(14) << total << "  " << right << setw(14) << npass << right << setw(9) << fixed << setprecision(3) << PP << "%" << endl;
+	if (GetDebugEnable()) {
+		output << "DEBUG TEXT: Datalog pool: " << PoolCounters.Allocations << " events, "
+		       << PoolCounters.HeapAllocations << " heap allocations, "
+		       << PoolCounters.Outstanding << " outstanding, "
+		       << PoolCounters.Rewinds << " rewinds" << endl;
+		output << "DEBUG TEXT: Datalog pool last device: " << PoolCounters.DeviceAllocations << " events, "
+		       << PoolCounters.DeviceHeapAllocations << " heap allocations" << endl;
+		if (TSRValid)
+			output << "DEBUG TEXT: TSR running totals used for " << TSRTotalsUsed << " of " << TSRInfo.TestNum.GetSize()
+			       << " records" << endl;
+	}
 }
 
 void SummaryData::
@@ -1232,42 +3066,35 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 			// Write TSR record
 			STDFV4_TSR TSR;
 			int num_recs = TSRInfo.TestNum.GetSize();
-			vector<unsigned int> num_tested(num_recs, 0);
-			vector<unsigned int> num_fails(num_recs, 0);
-			vector<double> min_val(num_recs, 1e100);
-			vector<double> max_val(num_recs, -1e100);
-			vector<double> sums(num_recs, 0.0);
-			vector<double> squares(num_recs, 0.0);
 			int ii = 0;
-			for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
+			// The per-site records come straight from TSRInfo
+			for (SiteIter s1 = LoadedSites.Begin(); SummaryBySite && (num_sites > 1) && !s1.End(); ++s1) {
 				SITE site = *s1;
 				for (ii = 0; ii < num_recs; ii++) {
 					if (TSRInfo.NumTested[site][ii] > 0) {
-						num_tested[ii] += TSRInfo.NumTested[site][ii];
-						num_fails[ii] += TSRInfo.NumFails[site][ii];
-						if (TSRInfo.MinValue[site][ii] < min_val[ii])
-							min_val[ii] = TSRInfo.MinValue[site][ii];
-						if (TSRInfo.MaxValue[site][ii] > max_val[ii])
-							max_val[ii] = TSRInfo.MaxValue[site][ii];
-						sums[ii] += TSRInfo.Sums[site][ii];
-						squares[ii] += TSRInfo.SumOfSquares[site][ii];
-						if (SummaryBySite && (num_sites > 1)) {
-							TSR.Reset();
-							TSR.SetContext(1, site);
-							StringS test_text = TSRInfo.TestText[ii];
-			
-							if (GetAppendPinName()) DatalogData::AppendPinNameToTestText(TSRInfo.PinName[ii], test_text);
-			
-							TSR.SetInfo(TSRInfo.TestNum[ii], TSRInfo.TestType[ii][0], UTL_VOID, test_text);
-							TSR.SetCounts(TSRInfo.NumTested[site][ii], TSRInfo.NumFails[site][ii]);
-							TSR.SetStats(TSRInfo.MinValue[site][ii], TSRInfo.MaxValue[site][ii], TSRInfo.Sums[site][ii], TSRInfo.SumOfSquares[site][ii]);
-							STDF.Write(TSR);
-						}
+						TSR.Reset();
+						TSR.SetContext(1, site);
+						StringS test_text = TSRInfo.TestText[ii];
+		
+						if (GetAppendPinName()) DatalogData::AppendPinNameToTestText(TSRInfo.PinName[ii], test_text);
+		
+						TSR.SetInfo(TSRInfo.TestNum[ii], TSRInfo.TestType[ii][0], UTL_VOID, test_text);
+						TSR.SetCounts(TSRInfo.NumTested[site][ii], TSRInfo.NumFails[site][ii]);
+						TSR.SetStats(TSRInfo.MinValue[site][ii], TSRInfo.MaxValue[site][ii], TSRInfo.Sums[site][ii], TSRInfo.SumOfSquares[site][ii]);
+						STDF.Write(TSR);
 					}
 				}
 			}
+			// The all-site records use the running totals where they could be
+			// collected, and reduce TSRInfo over the sites otherwise. Functional
+			// records keep their statistics from TSRInfo.
 			for (ii = 0; ii < num_recs; ii++) {
-				if (num_tested[ii] > 0) {
+				ST_TSRAccumulator::Stats stats;
+				if ((ii < (int)TSRTotalsValid.size()) && TSRTotalsValid[ii] && TSRTotals[ii].HasValues)
+					stats = TSRTotals[ii];
+				else
+					ReduceTSRRecord(ii, stats);
+				if (stats.NumTested > 0) {
 					TSR.Reset();
 					TSR.SetContext();
 					StringS test_text = TSRInfo.TestText[ii];
@@ -1275,8 +3102,8 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 					if (GetAppendPinName()) DatalogData::AppendPinNameToTestText(TSRInfo.PinName[ii], test_text);
 	
 					TSR.SetInfo(TSRInfo.TestNum[ii], TSRInfo.TestType[ii][0], UTL_VOID, test_text);
-					TSR.SetCounts(num_tested[ii], num_fails[ii]);
-					TSR.SetStats(min_val[ii], max_val[ii], sums[ii], squares[ii]);
+					TSR.SetCounts(stats.NumTested, stats.NumFails);
+					TSR.SetStats(stats.MinValue, stats.MaxValue, stats.Sums, stats.SumOfSquares);
 					STDF.Write(TSR);
 				}
 			}
@@ -1389,7 +3216,11 @@ Summary(const DatalogBaseUserData *udata)
 	SummaryNeeded = false;
 	bool DoFinal = (sdata != NULL) ? (sdata -> GetPartialSummary() ? false : true) : false;
         bool FileClosingAfterSummary = sdata ? sdata->GetFileClosingAfterSummary() : false;
-	return new SummaryData(*this, DoFinal, FileClosingAfterSummary);
+	// Flush barrier: the summary is always formatted synchronously, after the last queued device
+	FlushWriter();
+	SummaryData *data = new (*Pool) SummaryData(*this, DoFinal, FileClosingAfterSummary);
+	TSRAccum -> EndOfSummary();		// the devices after this summary start a new scope
+	return data;
 }
 
 // ***************************************************************************** 
@@ -1548,7 +3379,7 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 DatalogData *ST_Datalog::
 StartOfWafer(const DatalogBaseUserData *)
 {
-	return new StartOfWaferData(*this);
+	return Dispatch(new (*Pool) StartOfWaferData(*this));
 }
 
 // ***************************************************************************** 
@@ -1626,7 +3457,7 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 DatalogData *ST_Datalog::
 EndOfWafer(const DatalogBaseUserData *)
 {
-	return new EndOfWaferData(*this);
+	return Dispatch(new (*Pool) EndOfWaferData(*this));
 }
 
 // ***************************************************************************** 
@@ -1684,6 +3515,74 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 	output << endl << endl;
 }
 
+#ifndef DISABLE_DATALOG_CUSTOMIZATION
+// GDR recipes are loaded through the tinyxml2 DOM unless the datalog config
+// variable xtrf_parse_mode asks for the one pass streaming scan ("stream")
+static tinyxtrf::Xtrf::ParseMode GetXtrfParseModeOption()
+{
+	StringS temp;
+	if (TestProg.GetConfigVariableType("datalog", "xtrf_parse_mode") == "string")
+		if (TestProg.GetConfigVariableValue("datalog", "xtrf_parse_mode", temp) && (temp == "stream"))
+			return tinyxtrf::Xtrf::PARSE_STREAM;
+	return tinyxtrf::Xtrf::PARSE_DOM;
+}
+
+// Parse results of GDR recipes are saved in the datalog cache directory and loaded from
+// there while the recipe is unchanged, when the datalog config variable xtrf_sidecar is "on"
+static bool GetXtrfSidecarOption()
+{
+	StringS temp;
+	if (TestProg.GetConfigVariableType("datalog", "xtrf_sidecar") == "string")
+		if (TestProg.GetConfigVariableValue("datalog", "xtrf_sidecar", temp) && (temp == "on"))
+			return true;
+	return false;
+}
+
+// GDR recipe files for the lot: files, glob patterns or directories (their *.xtrf),
+// separated by blanks, commas or semicolons, from the datalog config variable xtrf_gdr_sources
+static std::string GetXtrfGdrSourcesOption()
+{
+	StringS temp;
+	if (TestProg.GetConfigVariableType("datalog", "xtrf_gdr_sources") == "string")
+		if (TestProg.GetConfigVariableValue("datalog", "xtrf_gdr_sources", temp) && (temp.Length() > 0))
+			return (const char *)temp;
+	return "/tmp/gdr.xtrf";
+}
+
+// GDR recipes are parsed at each lot start, unless the datalog config variable
+// xtrf_gdr_reload is "watch": they are then reparsed in the background whenever
+// the faModule updates them, and the lot start only picks up the last snapshot
+static bool GetXtrfGdrWatchOption()
+{
+	StringS temp;
+	if (TestProg.GetConfigVariableType("datalog", "xtrf_gdr_reload") == "string")
+		if (TestProg.GetConfigVariableValue("datalog", "xtrf_gdr_reload", temp) && (temp == "watch"))
+			return true;
+	return false;
+}
+
+// GDRs handed over by the faModule in shared memory, read before any XTRF recipe when
+// the datalog config variable xtrf_gdr_channel names the segment ("on" for the per user
+// one of tinyxtrf::XtrfGdrChannel::defaultName()). Off by default: the segment outlives
+// the lot it was written for, only a faModule that keeps it current should enable it
+static std::string GetXtrfGdrChannelOption()
+{
+	StringS temp;
+	if (TestProg.GetConfigVariableType("datalog", "xtrf_gdr_channel") == "string")
+		if (TestProg.GetConfigVariableValue("datalog", "xtrf_gdr_channel", temp) && (temp.Length() > 0) && (temp != "off"))
+			return (temp == "on") ? tinyxtrf::XtrfGdrChannel::defaultName() : std::string((const char *)temp);
+	return std::string();
+}
+
+// The reloader publishes to tinyxtrf::Xtrf::instance(), which must outlive it
+static std::unique_ptr<tinyxtrf::XtrfReloader> &GetGdrReloader()
+{
+	tinyxtrf::Xtrf::instance();
+	static std::unique_ptr<tinyxtrf::XtrfReloader> reloader;
+	return reloader;
+}
+#endif
+
 void StartOfLotData::
 FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 {
@@ -1848,116 +3747,93 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 			// This is a workaround to implement this feature.
 			// 2017/12/01: SPR170323 was reported to SW engineering to add this capability, but it is
 			//             very unlike we will fix it.
-            
-      std::cout << "<StartOfLotData::FormatSTDFV4> starting XTRF stuff..." << std::endl;
-    
-    std::vector<std::string> vGDRFiles;
-    vGDRFiles.push_back("/tmp/gdr.xtrf");
-     
-    for(std::vector<std::string>::iterator it = vGDRFiles.begin(); it != vGDRFiles.end(); ++it)
-    {                
+			std::cout << "<StartOfLotData::FormatSTDFV4> starting XTRF stuff..." << std::endl;
+			// Load the XTRF files generated by the faModule, containing all GDRs
+			std::vector<std::string> missingSources;
+			std::vector<std::string> vGDRFiles(tinyxtrf::Xtrf::expandSources(GetXtrfGdrSourcesOption(), &missingSources));
+			for(std::vector<std::string>::iterator it = missingSources.begin(); it != missingSources.end(); ++it) {
+				std::cout << "<StartOfLotData::FormatSTDFV4> no GDR file matches " << (*it) << std::endl;
+			}
 			tinyxtrf::Xtrf* xtrf(tinyxtrf::Xtrf::instance());
-			// Clear XTRF db
-			xtrf->clear();
-			// Get current login
-			std::string userName;
-			const struct passwd* userPwInfo(getpwuid(geteuid()));
-			if(NULL == userPwInfo) { userName = "JohnDoe_" + num2stdstring(geteuid()); }
-			else { userName = userPwInfo->pw_name; }
-
-         // Load the XTRF file generated by the faModule, containing all GDRs
-			std::ostringstream gdrXtrfFilename;
-			//gdrXtrfFilename << "/tmp/" << userName << "_" << static_cast< const char* >(TestProg.GetLotInfo("LotID")) << "_gdrs.xtrf";
-        //gdrXtrfFilename << "/tmp/gdr.xtrf";  	
-        //xtrf->parse(gdrXtrfFilename.str().c_str());
-        std::cout << "<StartOfLotData::FormatSTDFV4> processing " << (*it) << "..." << std::endl;
-        xtrf->parse((*it).c_str());
-			std::vector< tinyxtrf::GdrRecord > gdrRecords(xtrf->gdrs());
+			const tinyxtrf::Xtrf::ParseMode parseMode(GetXtrfParseModeOption());
+			xtrf->setSidecar(GetXtrfSidecarOption());
+			for(std::vector<std::string>::iterator it = vGDRFiles.begin(); it != vGDRFiles.end(); ++it) {
+				std::cout << "<StartOfLotData::FormatSTDFV4> processing " << (*it) << "..." << std::endl;
+			}
+			std::unique_ptr<tinyxtrf::XtrfReloader> &GdrReloader(GetGdrReloader());
+			std::shared_ptr<const tinyxtrf::XtrfSnapshot> gdrSnapshot;	// held for the whole replay, a reload meanwhile does not affect it
+			// GDRs the faModule published in shared memory need no parsing, the recipes are the fallback
+			std::vector< tinyxtrf::GdrDataList > channelGdrs;
+			const std::string gdrChannelName(GetXtrfGdrChannelOption());
+			bool fromChannel = false;
+			if(!gdrChannelName.empty()) {
+				tinyxtrf::XtrfGdrChannel gdrChannel(gdrChannelName);
+				fromChannel = gdrChannel.read(channelGdrs);
+				if(!fromChannel && !gdrChannel.error().empty())
+					std::cout << "<StartOfLotData::FormatSTDFV4> " << gdrChannel.error() << ", using the XTRF files" << std::endl;
+			}
+			if(fromChannel) {
+				std::cout << "<StartOfLotData::FormatSTDFV4> " << channelGdrs.size() << " GDRs from channel " << gdrChannelName << std::endl;
+			}
+			else if(GetXtrfGdrWatchOption()) {
+				// A new list is parsed once here, after that the reloader thread does all the
+				// reparsing and the lot start only takes the last snapshot, it never waits for one
+				if(!GdrReloader || (GdrReloader->files() != vGDRFiles) || (GdrReloader->parseMode() != parseMode) || (GdrReloader->sidecar() != xtrf->sidecar())) {
+					GdrReloader.reset();
+					GdrReloader.reset(new tinyxtrf::XtrfReloader(*xtrf, vGDRFiles, parseMode));
+					if(!GdrReloader->start()) {
+						// Not watched: the next lot start parses again
+						std::cout << "<StartOfLotData::FormatSTDFV4> " << GdrReloader->error() << std::endl;
+						GdrReloader.reset();
+					}
+					else if(!GdrReloader->error().empty())
+						std::cout << "<StartOfLotData::FormatSTDFV4> " << GdrReloader->error() << std::endl;
+				}
+				gdrSnapshot = xtrf->snapshot();
+			}
+			else {
+				GdrReloader.reset();
+				// Clear XTRF db
+				xtrf->clear();
+				xtrf->setParseMode(parseMode);
+				// Parsed concurrently, the GDRs come back in file order
+				if(!xtrf->parse(vGDRFiles))
+					std::cout << "<StartOfLotData::FormatSTDFV4> " << xtrf->getError() << std::endl;
+			}
+			const std::vector< tinyxtrf::GdrDataList > &gdrData = fromChannel ? channelGdrs : gdrSnapshot ? gdrSnapshot->m_gdrData : xtrf->gdrData();
             
-			// Parse records, and for each vector element, generate a GDR
-			for(std::vector< tinyxtrf::GdrRecord >::const_iterator gdrRecord = gdrRecords.begin(); gdrRecord != gdrRecords.end(); ++gdrRecord) 
+			// Replay the values compiled at parse time, one GDR per record
+			for(std::vector< tinyxtrf::GdrDataList >::const_iterator gdrRecord = gdrData.begin(); gdrRecord != gdrData.end(); ++gdrRecord) 
       {
 				STDFV4_GDR GDR;
-				//ArrayOfBasicVar GDRData;
-				int GdrIndex=0, GdrSize=0;
-				for(tinyxtrf::GdrRecord::const_iterator gdrField = gdrRecord->begin(); gdrField != gdrRecord->end(); ++gdrField) {
-					if(gdrField->m_name == "FIELD_CNT") {
-						std::stringstream str2intStream;
-						str2intStream << gdrField->m_value;
-						str2intStream >> GdrSize;
-						//GDRData.Resize(GdrSize);
-           std::cout << "<StartOfLotData::FormatSTDFV4> FIELD_CNT: "<<  gdrField->m_value << std::endl;
-                         
-					}
-					else if(gdrField->m_name == "GEN_DATA") 
-         				{
-						if(GdrIndex >= GdrSize) continue;
-						const std::string dataType(gdrField->m_type);
-						std::stringstream str2xStream;
-						str2xStream << gdrField->m_value;
-       			 			std::cout << "<StartOfLotData::FormatSTDFV4> GEN_DATA: "<<  gdrField->m_value << std::endl;
-						if(dataType == "C*n") 
-           					{                       
-							// Add datalog revision to the MIRADD.CONV_NAM/CONV_REV
-							std::string value = gdrField->m_value;
-							if(value.find("!DlogName!") != std::string::npos) {
-								value.replace(value.find("!DlogName!"), 10, STDLOG_NAME);
-							}
-							else if(value.find("!DlogRev!") != std::string::npos) {
-								value.replace(value.find("!DlogRev!"), 9, STDLOG_VERSION_STRING);
-							}
-            
-            GDR.PushBackCN(value.c_str(), value.size());
-							//GDRData[GdrIndex] = StringS(value.c_str());
-						}
-						else if(dataType.find("I*1") != std::string::npos) {
-							int value;	str2xStream >> value;
-            GDR.PushBackI1(value);
-							//GDRData[GdrIndex] = IntS(value);
-						}
-						else if(dataType.find("I*2") != std::string::npos) {
-							int value;	str2xStream >> value;
-            GDR.PushBackI2(value);
-							//GDRData[GdrIndex] = IntS(value);
+				for(tinyxtrf::GdrDataList::const_iterator gdrValue = gdrRecord->begin(); gdrValue != gdrRecord->end(); ++gdrValue) {
+					switch (gdrValue->m_type) {
+					case tinyxtrf::GDR_CN: {
+						// Add datalog revision to the MIRADD.CONV_NAM/CONV_REV
+						std::string value = gdrValue->m_str;
+						if(value.find("!DlogName!") != std::string::npos) {
+							value.replace(value.find("!DlogName!"), 10, STDLOG_NAME);
 						}
-						else if(dataType.find("I*4") != std::string::npos) {
-							int value;	str2xStream >> value;
-            GDR.PushBackI4(value);
-							//GDRData[GdrIndex] = IntS(value);
+						else if(value.find("!DlogRev!") != std::string::npos) {
+							value.replace(value.find("!DlogRev!"), 9, STDLOG_VERSION_STRING);
 						}
-						else if(dataType.find("U*1") != std::string::npos) {
-							unsigned int value; str2xStream >> value;
-             GDR.PushBackU1(value);
-							//GDRData[GdrIndex] = UnsignedS(value);
-						}   
-						else if(dataType.find("U*2") != std::string::npos) {
-							unsigned int value; str2xStream >> value;
-             GDR.PushBackU2(value);
-							//GDRData[GdrIndex] = UnsignedS(value);
-						}   
-						else if(dataType.find("U*4") != std::string::npos) {
-							unsigned int value; str2xStream >> value;
-             GDR.PushBackU4(value);
-							//GDRData[GdrIndex] = UnsignedS(value);
-						}   
-						else if(dataType.find("R*4") != std::string::npos) {
-							double value; str2xStream >> value;
-             GDR.PushBackR4(value);
-							//GDRData[GdrIndex] = FloatS(value);
-						}
-						else if(dataType.find("R*8") != std::string::npos) {
-							double value; str2xStream >> value;
-             GDR.PushBackR8(value);
-							//GDRData[GdrIndex] = FloatS(value);
-						}
-						//++GdrIndex;
+						GDR.PushBackCN(value.c_str(), value.size());
+						break;
+					}
+					case tinyxtrf::GDR_I1: GDR.PushBackI1(gdrValue->m_int);  break;
+					case tinyxtrf::GDR_I2: GDR.PushBackI2(gdrValue->m_int);  break;
+					case tinyxtrf::GDR_I4: GDR.PushBackI4(gdrValue->m_int);  break;
+					case tinyxtrf::GDR_U1: GDR.PushBackU1(gdrValue->m_uint); break;
+					case tinyxtrf::GDR_U2: GDR.PushBackU2(gdrValue->m_uint); break;
+					case tinyxtrf::GDR_U4: GDR.PushBackU4(gdrValue->m_uint); break;
+					case tinyxtrf::GDR_R4: GDR.PushBackR4(gdrValue->m_real); break;
+					case tinyxtrf::GDR_R8: GDR.PushBackR8(gdrValue->m_real); break;
 					}
 				}
 				// Generate the record
 				STDF.Write(GDR);
-       //unlink((*it).c_str());
 			}
-    }            
+       //for(std::vector<std::string>::iterator it = vGDRFiles.begin(); it != vGDRFiles.end(); ++it) unlink((*it).c_str());
 #endif
 		}
 	}
@@ -1967,7 +3843,9 @@ DatalogData *ST_Datalog::
 StartOfLot(const DatalogBaseUserData *)
 {
 	SummaryNeeded = true;
-	return new StartOfLotData(*this);
+	Shared -> DescCache.Clear();
+	TSRAccum -> Clear();
+	return Dispatch(new (*Pool) StartOfLotData(*this));
 }
 
 // ***************************************************************************** 
@@ -1976,6 +3854,7 @@ StartOfLot(const DatalogBaseUserData *)
 DatalogData *ST_Datalog::
 EndOfLot(const DatalogBaseUserData *)
 {
+	FlushWriter();			// Flush barrier, the lot is closed by the summary
 	return NULL;			// Processed as summary
 }
 
@@ -2012,7 +3891,7 @@ Format(const char *format, bool fail_only_mode, std::ostream &output)
 DatalogData *ST_Datalog::
 StartTestNode(const DatalogBaseUserData *)
 {
-	return new StartTestNodeData(*this);
+	return Dispatch(new (*Pool) StartTestNodeData(*this));
 }
 
 // ***************************************************************************** 
@@ -2029,21 +3908,25 @@ StartTestBlock(const DatalogBaseUserData *)
 
 class ParametricTestData : public ST_DatalogData {
 public:
-	ParametricTestData(ST_Datalog &, const DatalogParametric &pdata);
+	ParametricTestData(ST_Datalog &, ST_PreparedParametric *prep);
 	~ParametricTestData();
 
 	virtual void Format(const char *format, bool fail_only_mode, std::ostream &output);
+	virtual bool ResolveASCII(const char *format, bool fail_only_mode, std::ostream &output, ST_ParametricLines &lines);
 private:
-	DatalogParametric PData;
+	ST_PreparedParametric *Prep;			// may be shared with the other ST_Datalog instances
+	const DatalogParametric &PData;
 
+	void ResolveLines(bool fail_only_mode, std::ostream &output, ST_ParametricLines &lines);
 	void FormatASCII(bool fail_only_mode, std::ostream &output);
 	void FormatSTDFV4(bool fail_only_mode, std::ostream &output);
 };
 
 ParametricTestData::
-ParametricTestData(ST_Datalog &parent, const DatalogParametric &pdata) : 
+ParametricTestData(ST_Datalog &parent, ST_PreparedParametric *prep) : 
 	ST_DatalogData(DatalogMethod::ParametricTest, parent),
-	PData(pdata)
+	Prep(prep),
+	PData(prep -> PData)
 {
 	IncNumTestsExecuted();
 }
@@ -2051,6 +3934,7 @@ ParametricTestData(ST_Datalog &parent, const DatalogParametric &pdata) :
 ParametricTestData::
 ~ParametricTestData()
 {
+	Prep -> Release();
 }
 
 void ParametricTestData::
@@ -2128,30 +4012,221 @@ static void OutputParametricHeader(std::ostream &output, int field_width, bool c
 	output << endl;
 }
 
-static void PrintValue(std::ostream &output, SV_TYPE type, const BasicVar &Val, const StringS &units, int width, double scale, bool suppress_units, int int_part_width)
+// ***************************************************************************** 
+// ST_ASCIILine
+// Fixed-width line builder for the parametric ASCII datalog. It reproduces the
+// setw/left/right layout of the original stream code byte for byte, but the
+// fields are laid into a reusable char buffer and the line is handed to the
+// stream in a single write. Field rules, as with setw():
+//   Left/Right  pad to width, never truncate a longer field
+//   Blank       setw(width) << " ", i.e. at least one space
+// Values still go through DatalogBaseUserData::FormatSVData into a reused
+// scratch string so the numeric text stays identical to the system datalog.
+
+class ST_ASCIILine {
+public:
+	ST_ASCIILine();
+
+	void Clear();
+	void Append(const char *str, int len);
+	void Append(const StringS &str);
+	void Append(const std::string &str);
+	void Left(const char *str, int len, int width);
+	void Left(const StringS &str, int width);
+	void Left(const std::string &str, int width);
+	void Right(const char *str, int len, int width);
+	void Right(const StringS &str, int width);
+	void Right(const std::string &str, int width);
+	void Right(unsigned long value, int width);
+	void Blank(int width);
+	void Value(SV_TYPE type, const BasicVar &Val, const StringS &units, int width, double scale, bool suppress_units, int int_part_width);
+	void Value(SV_TYPE type, const BasicVar &Val, const std::string &units, int width, double scale, bool suppress_units, int int_part_width);
+	void Write(std::ostream &output);
+private:
+	std::vector<char> Buffer;
+	size_t Size;
+	StringS Scratch;
+
+	char *Reserve(size_t count);
+	void Value(SV_TYPE type, const BasicVar &Val, const char *units, int unit_width, int width, double scale, bool suppress_units,
+	           int int_part_width);
+
+	ST_ASCIILine(const ST_ASCIILine &);		// disable copy
+	ST_ASCIILine &operator=(const ST_ASCIILine &);	// disable copy
+};
+
+ST_ASCIILine::
+ST_ASCIILine() :
+	Buffer(512),
+	Size(0),
+	Scratch()
+{
+}
+
+void ST_ASCIILine::
+Clear()
+{
+	Size = 0;
+}
+
+char *ST_ASCIILine::
+Reserve(size_t count)
+{
+	if (Size + count > Buffer.size())
+		Buffer.resize((Size + count) * 2);
+	char *ptr = &Buffer[Size];
+	Size += count;
+	return ptr;
+}
+
+void ST_ASCIILine::
+Append(const char *str, int len)
+{
+	if (len > 0)
+		memcpy(Reserve(len), str, len);
+}
+
+void ST_ASCIILine::
+Append(const StringS &str)
+{
+	Append((const char *)str, str.Length());
+}
+
+void ST_ASCIILine::
+Append(const std::string &str)
+{
+	Append(str.data(), (int)str.size());
+}
+
+void ST_ASCIILine::
+Left(const char *str, int len, int width)
+{
+	const int pad = width - len;
+	char *ptr = Reserve(len + ((pad > 0) ? pad : 0));
+	memcpy(ptr, str, len);
+	if (pad > 0)
+		memset(ptr + len, ' ', pad);
+}
+
+void ST_ASCIILine::
+Left(const StringS &str, int width)
+{
+	Left((const char *)str, str.Length(), width);
+}
+
+void ST_ASCIILine::
+Left(const std::string &str, int width)
+{
+	Left(str.data(), (int)str.size(), width);
+}
+
+void ST_ASCIILine::
+Right(const char *str, int len, int width)
+{
+	const int pad = width - len;
+	char *ptr = Reserve(len + ((pad > 0) ? pad : 0));
+	if (pad > 0) {
+		memset(ptr, ' ', pad);
+		ptr += pad;
+	}
+	memcpy(ptr, str, len);
+}
+
+void ST_ASCIILine::
+Right(const StringS &str, int width)
+{
+	Right((const char *)str, str.Length(), width);
+}
+
+void ST_ASCIILine::
+Right(const std::string &str, int width)
+{
+	Right(str.data(), (int)str.size(), width);
+}
+
+void ST_ASCIILine::
+Right(unsigned long value, int width)
+{
+	char digits[24];
+	char *ptr = digits + sizeof(digits);
+	do {
+		*--ptr = char('0' + (value % 10));
+		value /= 10;
+	} while (value != 0);
+	Right(ptr, int(digits + sizeof(digits) - ptr), width);
+}
+
+void ST_ASCIILine::
+Blank(int width)
+{
+	Left(" ", 1, width);
+}
+
+// Same layout as the former PrintValue(): the value right aligned in the field,
+// optionally followed by the units, then two spaces.
+void ST_ASCIILine::
+Value(SV_TYPE type, const BasicVar &Val, const StringS &units, int width, double scale, bool suppress_units, int int_part_width)
+{
+	Value(type, Val, (const char *)units, units.Length(), width, scale, suppress_units, int_part_width);
+}
+
+void ST_ASCIILine::
+Value(SV_TYPE type, const BasicVar &Val, const std::string &units, int width, double scale, bool suppress_units, int int_part_width)
+{
+	Value(type, Val, units.data(), (int)units.size(), width, scale, suppress_units, int_part_width);
+}
+
+void ST_ASCIILine::
+Value(SV_TYPE type, const BasicVar &Val, const char *units, int unit_width, int width, double scale, bool suppress_units,
+      int int_part_width)
 {
 	if (Val.Valid()) {
-		StringS str;
-		int unit_width = units.Length();
 		int val_width = width;
 		if (!suppress_units) val_width -= unit_width;
-		if (DatalogBaseUserData::FormatSVData(str, type, Val, val_width, scale, int_part_width)) {
-			if (suppress_units) {
-				output << right << setw(val_width) << str << left << setw(2) << " ";
-			} else {
-				output << right << setw(val_width) << str << left << setw(unit_width) << units << setw(2) << " ";
-			}
-		} else {
-			output << setw(width + 2) << " ";
+		if (DatalogBaseUserData::FormatSVData(Scratch, type, Val, val_width, scale, int_part_width)) {
+			Right(Scratch, val_width);
+			if (!suppress_units)
+				Append(units, unit_width);
+			Append("  ", 2);
+			return;
 		}
 	}
+	Blank(width + 2);
+}
+
+void ST_ASCIILine::
+Write(std::ostream &output)
+{
+	*Reserve(1) = '\n';
+	output.write(&Buffer[0], Size);			// flushed once per record by the caller, not per line
+	// Leave the stream state as the stream code did
+	output.setf(std::ios::left, std::ios::adjustfield);
+	output.setf(std::ios::dec, std::ios::basefield);
+	Size = 0;
+}
+
+// One line buffer per formatting thread, reused for every parametric line
+static ST_ASCIILine &GetASCIILine()
+{
+	static thread_local ST_ASCIILine line;
+	line.Clear();
+	return line;
+}
+
+template <class S> static void OutputPassFail(ST_ASCIILine &line, TM_RESULT Res, const S &pass_string, int width)
+{
+	if (Res == TM_PASS)
+		line.Right(pass_string, width);
+	else if (Res == TM_FAIL)
+		line.Right("*F*", 3, width);
 	else
-		output << setw(width + 2) << " ";
+		line.Right("   ", 3, width);
 }
 
-static void OutputParametricSiteASCII(	std::ostream &output, 
+template <class S> static void OutputParametricSiteASCII(	std::ostream &output, 
+					ST_ASCIILine &line,
 					SITE site, 
-					const UnsignedS &TestID, 
+					unsigned int TestID, 
 					TM_RESULT Res,
 					const int field_width,
 					const double scale,
@@ -2159,84 +4234,92 @@ static void OutputParametricSiteASCII(	std::ostream &output,
 					const BasicVar &LL, 
 					const BasicVar &HL,
 					const bool separate_units,
-					const StringS &units, 
-					const PinML &pins, 
-					const StringS &comment, 
-					const StringS pass_string,
+					const S &units, 
+					const S &pin_str, 
+					const S &comment, 
+					const S &pass_string,
 					const int int_part_width)
 {
 	const bool omit_pin_name = false;
 
-	output << setw(TNSize) << right << dec << TestID << setw(2) << " ";
-	StringS PF = (Res == TM_PASS) ? pass_string : (Res == TM_FAIL) ? "*F*" : "   ";
-	output << setw(3) << PF << setw(2) << " ";
-	output << setw(4) << right << site << setw(2) << " ";
+	line.Right(TestID, TNSize);
+	line.Append("  ", 2);
+	OutputPassFail(line, Res, pass_string, 3);
+	line.Append("  ", 2);
+	line.Right((unsigned long)site, 4);
+	line.Append("  ", 2);
 	SV_TYPE var_type = TV.Valid() ? TV.GetType() : LL.Valid() ? LL.GetType() : HL.GetType();
-	PrintValue(output, var_type, LL, units, field_width, scale, separate_units, int_part_width);
-	PrintValue(output, var_type, TV, units, field_width, scale, separate_units, int_part_width);
-	PrintValue(output, var_type, HL, units, field_width, scale, separate_units, int_part_width);
+	line.Value(var_type, LL, units, field_width, scale, separate_units, int_part_width);
+	line.Value(var_type, TV, units, field_width, scale, separate_units, int_part_width);
+	line.Value(var_type, HL, units, field_width, scale, separate_units, int_part_width);
 	if (separate_units) {
-		output << setw(8) << left << units << setw(2) << " ";
+		line.Left(units, 8);
+		line.Append("  ", 2);
 	}
 	if (!omit_pin_name) {
-		StringS str;
-		DatalogBaseUserData::FormatPins(str, pins, PGSize);
-		output << setw(PGSize) << left << str << setw(2) << " ";
+		line.Left(pin_str, PGSize);
+		line.Append("  ", 2);
 	}
-	output << left << comment;
-	output << endl;
+	line.Append(comment);
+	line.Write(output);
 }
 
-static void OutputParametricLineStartASCII(     std::ostream &output,
-										const UnsignedS &TestID,
+template <class S> static void OutputParametricLineStartASCII(     ST_ASCIILine &line,
+										unsigned int TestID,
 										const int field_width,
 										double scale,
 										const BasicVar &TV,
 										const BasicVar &LL,
 										const BasicVar &HL,
-										const StringS &units,
+										const S &units,
 										const int int_part_width)
 {
 	// This is called in column mode to print the first part of the test data
-	output << setw(TNSize) << right << dec << TestID << left << setw(2) << " ";
+	line.Right(TestID, TNSize);
+	line.Append("  ", 2);
 	SV_TYPE var_type = TV.Valid() ? TV.GetType() : LL.Valid() ? LL.GetType() : HL.GetType();
-	PrintValue(output, var_type, LL, units, field_width, scale, true, int_part_width);
+	line.Value(var_type, LL, units, field_width, scale, true, int_part_width);
 }
 
-static void OutputParametricLineEndASCII(   std::ostream &output,
+template <class S> static void OutputParametricLineEndASCII(   std::ostream &output,
+											ST_ASCIILine &line,
 											const int field_width,
 											double limit_scale,
 											const BasicVar &TV,
 											const BasicVar &LL,
 											const BasicVar &HL,
-											const StringS &units,
-											const PinML &pins,
-											const StringS &comment,
+											const S &units,
+											const S &pin_str,
+											const S &comment,
 											const int int_part_width)
 {
 	// This is called in column mode to complete the line of test data
 	const bool omit_pin_name = false;
 
 	SV_TYPE var_type = TV.Valid() ? TV.GetType() : LL.Valid() ? LL.GetType() : HL.GetType();
-	PrintValue(output, var_type, HL, units, field_width, limit_scale, true, int_part_width);
-	output << setw(UnitSize) << left << units << setw(2) << " ";
+	line.Value(var_type, HL, units, field_width, limit_scale, true, int_part_width);
+	line.Left(units, UnitSize);
+	line.Append("  ", 2);
 	if (!omit_pin_name) {
-		StringS str;
-		DatalogBaseUserData::FormatPins(str, pins, PGSize);
-		output << setw(PGSize) << left << str << setw(2) << " ";
+		line.Left(pin_str, PGSize);
+		line.Append("  ", 2);
 	}
-	output << left << comment;
-	output << endl;
+	line.Append(comment);
+	line.Write(output);
 }
 
+// Resolves the ASCII lines of the event on the test thread: the header, the
+// sites, scales and strings. Only the values are left to RenderParametricLines.
 void ParametricTestData::
-FormatASCII(bool fail_only_mode, std::ostream &output)
+ResolveLines(bool fail_only_mode, std::ostream &output, ST_ParametricLines &lines)
 {
-	int field_width = GetFieldWidth();
-	int int_part_width = GetIntegerPartWidth();
+	lines.FieldWidth = GetFieldWidth();
+	lines.IntPartWidth = GetIntegerPartWidth();
+	lines.Columns = GetASCIIDatalogInColumns();
+	lines.NumLines = 0;
 
 	if ((GetLastFormatEvent() != DatalogMethod::ParametricTest) && (GetLastFormatEvent() != DatalogMethod::ParametricTestArray))
-		OutputParametricHeader(output, field_width, GetASCIIDatalogInColumns(), false);
+		OutputParametricHeader(output, lines.FieldWidth, lines.Columns, false);
 
 	// store first and last tested site for later
 	Sites fsites = GetDlogSites();
@@ -2245,24 +4328,24 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 
 	const TMResultM &Res = PData.GetResult();
 	if (fail_only_mode)
-		(void)fsites.DisableFailingSites(Res.Equal(TM_FAIL));	// This removes anything that is not a fail due to Equal
+		fsites = Prep -> GetFailSites(fsites);
 	const StringS &units = PData.GetUnits();
-	StringS real_units, str, tdesc;
-	StringS testText = PData.GetComment();
-
-	if (GetAppendPinName()) DatalogData::AppendPinNameToTestText(PData.GetPins(), testText);
-		
-	FormatTestDescription(tdesc, testText);
+	StringS real_units;
+	lines.TestID = PData.GetTestID();
+	const ST_DescriptionCache::Entry &text = FormatParametricText(lines.TestID, PData.GetComment(), PData.GetPins(), GetAppendPinName(), true);
+	AssignString(lines.Description, text.Description);
+	AssignString(lines.PinString, text.PinString);
 	// scale gets set to the inverse of the unit multiplier, eg if unit = mA then scale = 1e3
 	// real_units gets set to the base unit of units, with the multiplier removed, e.g. if unit = mA then real_units = A
-	double scale = PData.CalculateUnitScale(units, real_units);
+	double scale = CalculateUnitScale(PData, units, real_units, false);
 	// if no known unit found and autoscaling is not on then set scale to 1.0
 	if ( scale == 0.0 && !GetUnitAutoscaling() ) scale = 1.0;
+	AssignString(lines.PassString, GetPassString());
 
-	if (GetASCIIDatalogInColumns()) {
+	if (lines.Columns) {
 		// this section for column-oriented output
-		// iterator for tested sites
-		SiteIter tested = fsites.Begin();
+		// datalogged (or failing) sites
+		const ST_SiteSet tested(fsites);
 		// get limits and result from first datalogged site, necessary compromise for column output
 		SITE limit_site = fsites.Begin().GetValue();
 		const BasicVar &TV_first = PData.GetBaseSData(DatalogParametric::Test,      limit_site);
@@ -2272,42 +4355,110 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 		// limit_scale gets set to the inverse of the unit multiplier, eg if unit = mA then scale = 1e3
 		// limit_units gets set to the engineering unit that covers the max of the value, the low limit and the high limit
 		StringS limit_units = units;
-		double limit_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, limit_units, TV_first, LL, HL);
+		lines.Limits.Scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, limit_units, TV_first, LL, HL);
+		lines.Limits.TV = &TV_first;
+		lines.Limits.LL = &LL;
+		lines.Limits.HL = &HL;
+		AssignString(lines.Limits.Units, limit_units);
 
 		for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
 			SITE site = *s1;
-			if (site == first_site) {
-				OutputParametricLineStartASCII(output, PData.GetTestID(), field_width, limit_scale, TV_first, LL, HL, limit_units, int_part_width);
-			}
-			if (site == *tested) {
-				const BasicVar &TV = PData.GetBaseSData(DatalogParametric::Test, *s1);
-				double real_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, real_units, TV, LL, HL);
-				StringS PF = (Res[site] == TM_PASS) ? GetPassString() : (Res[site] == TM_FAIL) ? "*F*" : "   ";
-				output << PF << " ";
-				SV_TYPE var_type = TV.Valid() ? TV.GetType() : LL.Valid() ? LL.GetType() : HL.GetType();
-				PrintValue(output, var_type, TV, real_units, field_width, real_scale, true, int_part_width);
-				if (!tested.End())
-					++tested;
-			} else {
-				output << "    " << setw(field_width) << " " << "  ";
-			}
-			if (site == last_site) {
-				OutputParametricLineEndASCII(output, field_width, limit_scale, TV_first, LL, HL, limit_units, PData.GetPins(), tdesc, int_part_width);
+			ST_ParametricLines::SiteLine &line = lines.AddLine(site);
+			line.First = (site == first_site);
+			line.Last = (site == last_site);
+			if (tested.Contains(site)) {
+				const BasicVar &TV = PData.GetBaseSData(DatalogParametric::Test, site);
+				line.Tested = true;
+				line.Result = Res[site];
+				line.Val.TV = &TV;
+				line.Val.LL = &LL;
+				line.Val.HL = &HL;
+				line.Val.Scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, real_units, TV, LL, HL);
+				AssignString(line.Val.Units, real_units);
 			}
 		}
 	} else {
 		// this section for row-oriented output
 		for (SiteIter s1 = fsites.Begin(); !s1.End(); ++s1) {
 			SITE site = *s1;
+			ST_ParametricLines::SiteLine &line = lines.AddLine(site);
 			const BasicVar &TV = PData.GetBaseSData(DatalogParametric::Test, site);
 			const BasicVar &LL = PData.GetBaseSData(DatalogParametric::LowLimit, site);
 			const BasicVar &HL = PData.GetBaseSData(DatalogParametric::HighLimit, site);
-			double real_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, real_units, TV, LL, HL);
-			OutputParametricSiteASCII(output, site, PData.GetTestID(), Res[site], field_width, real_scale, TV, LL, HL, false, real_units, PData.GetPins(), tdesc, GetPassString(), int_part_width);
+			line.Tested = true;
+			line.Result = Res[site];
+			line.Val.TV = &TV;
+			line.Val.LL = &LL;
+			line.Val.HL = &HL;
+			line.Val.Scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, real_units, TV, LL, HL);
+			AssignString(line.Val.Units, real_units);
 		}
 	}
 }
 
+// Lays out resolved lines. Reads nothing but the lines and the values they
+// point to, the writer thread calls it in async mode.
+static void RenderParametricLines(const ST_ParametricLines &lines, std::ostream &output)
+{
+	ST_ASCIILine &line = GetASCIILine();
+	const ST_ParametricLines::Value &limits = lines.Limits;
+	for (size_t ii = 0; ii < lines.NumLines; ii++) {
+		const ST_ParametricLines::SiteLine &site_line = lines.Lines[ii];
+		const ST_ParametricLines::Value &val = site_line.Val;
+		if (!lines.Columns) {
+			OutputParametricSiteASCII(output, line, site_line.Site, lines.TestID, site_line.Result, lines.FieldWidth, val.Scale, *val.TV, *val.LL, *val.HL,
+			                          false, val.Units, lines.PinString, lines.Description, lines.PassString, lines.IntPartWidth);
+			continue;
+		}
+		if (site_line.First)
+			OutputParametricLineStartASCII(line, lines.TestID, lines.FieldWidth, limits.Scale, *limits.TV, *limits.LL, *limits.HL, limits.Units, lines.IntPartWidth);
+		if (site_line.Tested) {
+			OutputPassFail(line, site_line.Result, lines.PassString, 0);
+			line.Append(" ", 1);
+			const BasicVar &TV = *val.TV;
+			SV_TYPE var_type = TV.Valid() ? TV.GetType() : val.LL -> Valid() ? val.LL -> GetType() : val.HL -> GetType();
+			line.Value(var_type, TV, val.Units, lines.FieldWidth, val.Scale, true, lines.IntPartWidth);
+		} else {
+			line.Append("    ", 4);
+			line.Blank(lines.FieldWidth);
+			line.Append("  ", 2);
+		}
+		if (site_line.Last)
+			OutputParametricLineEndASCII(output, line, lines.FieldWidth, limits.Scale, *limits.TV, *limits.LL, *limits.HL, limits.Units, lines.PinString,
+			                             lines.Description, lines.IntPartWidth);
+	}
+}
+
+// One set of lines per formatting thread, reused for every synchronous event
+static ST_ParametricLines &GetParametricLines()
+{
+	static thread_local ST_ParametricLines lines;
+	return lines;
+}
+
+void ParametricTestData::
+FormatASCII(bool fail_only_mode, std::ostream &output)
+{
+	ST_ParametricLines &lines = GetParametricLines();
+	ResolveLines(fail_only_mode, output, lines);
+	RenderParametricLines(lines, output);
+	if (lines.NumLines > 0)
+		output.flush();
+}
+
+// Async mode: the lines are resolved here on the test thread, and laid out by the writer thread
+bool ParametricTestData::
+ResolveASCII(const char *format, bool fail_only_mode, std::ostream &output, ST_ParametricLines &lines)
+{
+	if ((format == NULL) || (format[0] != formats[ASCII_INDEX][0]))
+		return false;
+	ResolveLines(fail_only_mode, output, lines);
+	Prep -> AddRef();				// the values stay in the payload until the entry is reclaimed
+	lines.Prep = Prep;
+	SetLastFormatEvent();
+	return true;
+}
+
 static const char *GetDefaultFormat(const BasicVar &var)
 {
     if ((var.GetType() == SV_INT) || (var.GetType() == SV_UINT))
@@ -2324,15 +4475,11 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 		Sites fsites = GetDlogSites();
 		const TMResultM &Res = PData.GetResult();
 		if (fail_only_mode)
-			(void)fsites.DisableFailingSites(Res.Equal(TM_FAIL));	// This removes anything that is not a fail due to Equal
+			fsites = Prep -> GetFailSites(fsites);
 		const StringS &units = PData.GetUnits();
-		StringS real_units, str, tdesc;
-		StringS testText = PData.GetComment();
-
-		if (GetAppendPinName()) DatalogData::AppendPinNameToTestText(PData.GetPins(), testText);
-		
-		FormatTestDescription(tdesc, testText);
-                double scale = PData.CalculateBaseUnitScale(units, real_units);
+		StringS real_units, str;
+		const StringS &tdesc = FormatParametricText(PData.GetTestID(), PData.GetComment(), PData.GetPins(), GetAppendPinName(), false).Description;
+                double scale = CalculateUnitScale(PData, units, real_units, true);
                 if ( scale == 0.0 && !GetUnitAutoscaling() ) scale = 1.0;
 		PTR.SetInfo(PData.GetTestID(), tdesc);
 		PTR.SetUnits(real_units);
@@ -2342,7 +4489,7 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 			if (TV != UTL_VOID) {
 				const BasicVar &LL = PData.GetBaseSData(DatalogParametric::LowLimit, site);
 				const BasicVar &HL = PData.GetBaseSData(DatalogParametric::HighLimit, site);
-				double real_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, real_units, TV, LL, HL);
+				double real_scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, real_units, TV, LL, HL);
 				if (real_scale != 0.0)
 					real_scale = 1.0 / real_scale;			// STDF routine wants value, not multiplier
 				const char *fmt = GetDefaultFormat(TV);
@@ -2362,7 +4509,9 @@ ParametricTest(const DatalogBaseUserData *udata)
 	const DatalogParametric *pdata = dynamic_cast<const DatalogParametric *>(udata);
 	if (pdata != NULL) {
 		SummaryNeeded = true;
-		return new ParametricTestData(*this, *pdata);
+		TSRAccum -> AddParametric(*pdata);
+		ST_PreparedParametric *prep = Shared -> Prepare(*pdata, udata, DeviceCount, EventIndex++, *Pool);
+		return Dispatch(new (*Pool) ParametricTestData(*this, prep));
  	}
 	return NULL;
 }
@@ -2419,22 +4568,26 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 	const TMResultM1D &Res1D = PData.GetResults();
 	const Sites &dlog_sites = GetDlogSites();
 	const StringS &units = PData.GetUnits();
-	StringS real_units, str, tdesc;
-	FormatTestDescription(tdesc, PData.GetComment());
+	StringS real_units, str, pin_str;
+	const StringS &tdesc = FormatParametricText(PData.GetTestID(), PData.GetComment(), PData.GetPins(), false, false).Description;
 	// scale gets set to the inverse of the unit multiplier, eg if unit = mA then scale = 1e3
 	// real_units gets set to the base unit of units, with the multiplier removed, e.g. if unit = mA then real_units = A
-	double scale = PData.CalculateUnitScale(units, real_units);
+	double scale = CalculateUnitScale(PData, units, real_units, false);
 	if ( scale == 0.0 && !GetUnitAutoscaling() ) scale = 1.0;
 	const PinML &Pins = PData.GetPins();
 	int npins = Pins.GetNumPins();
 	int nvalues = PData.GetNumValues(DatalogParametricArray::Test);
 
+	ST_ASCIILine &line = GetASCIILine();
+	const StringS pass_string = GetPassString();
+
 	if (GetASCIIDatalogInColumns()) {
 		// this section for column-oriented output
 		unsigned int test_id = PData.GetTestID();
 		SITE first_site = LoadedSites.Begin().GetValue();
 		SITE limit_site = dlog_sites.Begin().GetValue();
 		SITE last_site = LoadedSites.GetLargestSite();
+		const ST_SiteSet tested(dlog_sites);
 		for (int ii = 0; ii < nvalues; ++ii) {
 			TMResultM ResM = Res1D[ii];
 			BasicVar TV_first, LL, HL;
@@ -2446,34 +4599,36 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 			// limit_scale gets set to the inverse of the unit multiplier, eg if unit = mA then scale = 1e3
 			// limit_units gets set to the engineering unit that covers the max of the value, the low limit and the high limit
 			StringS limit_units = units;
-			double limit_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, limit_units, TV_first, LL, HL);
+			double limit_scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, limit_units, TV_first, LL, HL);
 	
 			if (!(ResM==TM_PASS) || !fail_only_mode) {
-				SiteIter tested = dlog_sites.Begin();
 				for (SiteIter s1 = LoadedSites.Begin(); !s1.End(); ++s1) {
 					SITE site = *s1;
 					if (site == first_site) {
-						OutputParametricLineStartASCII(output, PData.GetTestID(), field_width, limit_scale, TV_first, LL, HL, limit_units, int_part_width);
+						OutputParametricLineStartASCII(line, test_id, field_width, limit_scale, TV_first, LL, HL, limit_units, int_part_width);
 					}
-					if (site == *tested) {
+					if (tested.Contains(site)) {
 						BasicVar TV;
 						PData.StuffSData(TV, DatalogParametricArray::Test, ii, site);
-						double real_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, real_units, TV, LL, HL);
+						double real_scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, real_units, TV, LL, HL);
 						if (!(ResM[site]==TM_PASS) || !fail_only_mode) {
-							StringS PF = (ResM[site] == TM_PASS) ? GetPassString() : (ResM[site] == TM_FAIL) ? "*F*" : "   ";
-							output << PF << " ";
+							OutputPassFail(line, ResM[site], pass_string, 0);
+							line.Append(" ", 1);
 							SV_TYPE var_type = TV.Valid() ? TV.GetType() : LL.Valid() ? LL.GetType() : HL.GetType();
-							PrintValue(output, var_type, TV, real_units, field_width, real_scale, true, int_part_width);
+							line.Value(var_type, TV, real_units, field_width, real_scale, true, int_part_width);
 						} else {
-							output << "    " << setw(field_width) << " " << "  ";
+							line.Append("    ", 4);
+							line.Blank(field_width);
+							line.Append("  ", 2);
 						}
-						if (!tested.End())
-							++tested;
 					} else {
-						output << "    " << setw(field_width) << " " << "  ";
+						line.Append("    ", 4);
+						line.Blank(field_width);
+						line.Append("  ", 2);
 					}
 					if (site == last_site) {
-						OutputParametricLineEndASCII(output, field_width, limit_scale, TV_first, LL, HL, limit_units, (ii < npins ? Pins[ii] : PinML(UTL_VOID)), tdesc, int_part_width);
+						DatalogBaseUserData::FormatPins(pin_str, (ii < npins ? Pins[ii] : PinML(UTL_VOID)), PGSize);
+						OutputParametricLineEndASCII(output, line, field_width, limit_scale, TV_first, LL, HL, limit_units, pin_str, tdesc, int_part_width);
 					}
 				}
 			}
@@ -2491,11 +4646,13 @@ FormatASCII(bool fail_only_mode, std::ostream &output)
 				PData.StuffSData(TV, DatalogParametricArray::Test, ii, site);
 				PData.StuffSData(LL, DatalogParametricArray::LowLimit, ii, site);
 				PData.StuffSData(HL, DatalogParametricArray::HighLimit, ii, site);
-				double real_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(units, real_units, TV, LL, HL);
-				OutputParametricSiteASCII(output, site, test_id, Res[ii], field_width, real_scale, TV, LL, HL, false, real_units, (ii < npins ? Pins[ii] : PinML(UTL_VOID)), tdesc, GetPassString(), int_part_width);
+				double real_scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, units, real_units, TV, LL, HL);
+				DatalogBaseUserData::FormatPins(pin_str, (ii < npins ? Pins[ii] : PinML(UTL_VOID)), PGSize);
+				OutputParametricSiteASCII(output, line, site, test_id, Res[ii], field_width, real_scale, TV, LL, HL, false, real_units, pin_str, tdesc, pass_string, int_part_width);
 			}
 		}
 	}
+	output.flush();
 }
 
 static bool PerPinLimits(const BasicVar &LL, const BasicVar &HL)
@@ -2596,9 +4753,9 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 		const TMResultM1D &Res1D = PData.GetResults();
 		const Sites &dlog_sites = GetDlogSites();
 		const StringS &units = PData.GetUnits();
-		StringS real_units, str, tdesc;
-		FormatTestDescription(tdesc, PData.GetComment());
-                double scale = PData.CalculateBaseUnitScale(units, real_units);
+		StringS real_units, str;
+		const StringS &tdesc = FormatParametricText(PData.GetTestID(), PData.GetComment(), PData.GetPins(), false, false).Description;
+                double scale = CalculateUnitScale(PData, units, real_units, true);
                 if ( scale == 0.0 && !GetUnitAutoscaling() ) scale = 1.0;
 		MPR.SetInfo(PData.GetTestID(), tdesc);
 		MPR.SetUnits(real_units);
@@ -2608,7 +4765,7 @@ FormatSTDFV4(bool fail_only_mode, std::ostream &output)
 			const BasicVar &LL = PData.GetBaseS1DData(DatalogParametricArray::LowLimit, site);
 			const BasicVar &HL = PData.GetBaseS1DData(DatalogParametricArray::HighLimit, site);
 			const char *fmt = GetDefaultFormat(TV);
-                        double real_scale = (scale != 0.0) ? scale : PData.CalculateAutoRangeUnitScale(real_units, str, TV, LL, HL);
+                        double real_scale = (scale != 0.0) ? scale : CalculateAutoRangeUnitScale(PData, real_units, str, TV, LL, HL);
 			if (real_scale != 0.0)
 				real_scale = 1.0 / real_scale;				// STDF routine wants value, not multiplier
 			if (PerPinLimits(LL, HL)) {					// Implement as an array of PTRs
@@ -2655,7 +4812,8 @@ ParametricTestArray(const DatalogBaseUserData *udata)
 	const DatalogParametricArray *pdata = dynamic_cast<const DatalogParametricArray *>(udata);
 	if (pdata != NULL) {
 		SummaryNeeded = true;
-		return new ParametricTestDataArray(*this, *pdata);
+		TSRAccum -> AddPartial(pdata -> GetTestID());
+		return Dispatch(new (*Pool) ParametricTestDataArray(*this, *pdata));
  	}
 	return NULL;
 }
@@ -3065,7 +5223,8 @@ FunctionalTest(const DatalogBaseUserData *udata)
 	const DatalogFunctional *fdata = dynamic_cast<const DatalogFunctional *>(udata);
 	if (fdata != NULL) {
 		SummaryNeeded = true;
-		return new FunctionalTestData(*this, *fdata);
+		TSRAccum -> AddFunctional(fdata -> GetTestID(), fdata -> GetResult());
+		return Dispatch(new (*Pool) FunctionalTestData(*this, *fdata));
  	}
 	return NULL;
 }
@@ -3252,7 +5411,7 @@ ScanTest(const DatalogBaseUserData *udata)
 	const DatalogFunctional *fdata = dynamic_cast<const DatalogFunctional *>(udata);
 	if ((fdata != NULL) && (EnableScan2007.GetValue() == true) && DIGITAL.GetScanInfoAvailable()) {
 		SummaryNeeded = true;
-		return new ScanTestData(*this, *fdata);
+		return Dispatch(new (*Pool) ScanTestData(*this, *fdata));
  	}
 	return NULL;
 }
@@ -3332,7 +5491,7 @@ Text(const DatalogBaseUserData *udata)
 	const DatalogText *tdata = dynamic_cast<const DatalogText *>(udata);
 	if (tdata != NULL) {
 		SummaryNeeded = true;
-		return new TextData(*this, *tdata);
+		return Dispatch(new (*Pool) TextData(*this, *tdata));
  	}
 	return NULL;
 }
@@ -3782,7 +5941,7 @@ Generic(const DatalogBaseUserData *udata)
 	const DatalogGeneric *gdata = dynamic_cast<const DatalogGeneric *>(udata);
 	if (gdata != NULL) {
 		SummaryNeeded = true;
-		return new GenericData(*this, *gdata);
+		return Dispatch(new (*Pool) GenericData(*this, *gdata));
  	}
 	return NULL;
 }
@@ -15,6 +15,8 @@
 #warning Datalog Customization was disabled
 #endif
 
+//#define ST_DATALOG_VERIFY_TSR		// check the running TSR totals against TSRInfo at every summary
+
 #ifndef LTXC_DATALOG
 #define STDLOG_NAME				"ST-TPY Datalog"
 #define STDLOG_VERSION			17090100		// 170901=>U1709-1, 00=>Custom rev 00
@@ -22,6 +24,10 @@
 #endif
 
 class ST_DatalogData;                    // forward reference
+class ST_DatalogWriter;                  // forward reference
+class ST_DatalogPool;                    // forward reference
+class ST_SharedStage;                    // forward reference
+class ST_TSRAccumulator;                 // forward reference
 
 // The following is the main LTXC Datalog class declaration. The class is composed of:
 //     A set of DatalogAttributes that compose the optional parameters for the datalogger.
@@ -139,6 +145,15 @@ public:
                                             of floating point values in ASCII output.  This wider
                                             representation is intended for cases where the user wants
                                             to use unscaled values.  It does not affect STDF output.
+	- AsyncFormatting -                 If enabled, the ASCII parametric results are laid out and
+                                            written to the datalog file by a dedicated writer thread, in
+                                            order with the rest of the output. The other ASCII events are
+                                            formatted into memory on the test thread and written by the
+                                            writer thread. STDFv4 records are still written on the test
+                                            thread. While the mode is on, the ASCII datalog stream is
+                                            written by the writer thread only; it is drained before any
+                                            Summary, at EndOfLot and at program unload, so the summary
+                                            and the file close always follow the last device record.
                                             
 
 	@par Summary Data Collection
@@ -180,16 +195,28 @@ private:
 	DatalogAttribute EnableFullOpt;                 // LTXC specific optimization versus STDFV4 specified
 	DatalogAttribute EnableScan2007;		// Enabled STDF V4 2007.1 Scan support
 	DatalogAttribute ASCIIOptimizeForUnscaledValues;// Use larger width for integer part
+	DatalogAttribute AsyncFormatting;               // Write ASCII output on a background thread
 	PinML VerbosePins;                              // Cache for functional verbose pin header
 	UnsignedM NumTestsExecuted;                     // Number of PTR, MPR, and FTRs executed in last run
 	FloatS FinishTime;                              // Time of last execution, updated at EOT
 	int FieldWidth;                                 // this one is set by the ST_Datalog_FieldWidth OpVar if present.
 	                                                // Checked and changed in StartOfTest event
 	StringS PassString;                             // Stores pass string value
+	ST_DatalogWriter *Writer;                       // Background output writer, created on first async event
+	ST_DatalogPool *Pool;                           // Backing store for the event objects
+	ST_SharedStage *Shared;                         // Caches and prepared events shared by all instances
+	unsigned long DeviceCount;                      // Devices started, identifies shared prepared events
+	unsigned long EventIndex;                       // Parametric events in the current device
+	ST_TSRAccumulator *TSRAccum;                    // Running per-test TSR totals since StartOfLot
 
 	ST_Datalog(const ST_Datalog &);             // disable copy
 	ST_Datalog &operator=(const ST_Datalog &);  // disable copy
 
+	// Hands a collected event to the system, or to the writer thread in async mode
+	DatalogData *Dispatch(ST_DatalogData *data);
+	// Waits until every event queued to the writer thread has been written
+	void FlushWriter();
+
 	// The following are the data collection methods
 	DatalogData *StartOfTest(const DatalogBaseUserData *);
 	DatalogData *EndOfTest(const DatalogBaseUserData *);
@@ -32,6 +32,18 @@ distribution.
 #   include <cstdarg>
 #endif
 
+// Vectorized scanners for the hot parse loops: SSE2 where the compiler targets it,
+// AVX2 picked at run time. target("avx2") functions may only use the AVX2
+// intrinsics from GCC 4.9 on.
+#if defined(__SSE2__) && defined(__GNUC__)
+#   include <emmintrin.h>
+#   define TIXML_SIMD_SSE2
+#   if defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+#       include <immintrin.h>
+#       define TIXML_SIMD_AVX2
+#   endif
+#endif
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1400 ) && (!defined WINCE)
 	// Microsoft Visual Studio, version 2005 and higher. Not WinCE.
 	/*int _snprintf_s(
@@ -135,6 +147,251 @@ static const Entity entities[NUM_ENTITIES] = {
 };
 
 
+/*
+	Scanners. Each one returns the first byte of the NUL terminated text at p that
+	stops it, adding the newlines it passed to *curLineNumPtr (when given):
+		ScanWhiteSpace	- first byte that is not XMLUtil::IsWhiteSpace()
+		ScanText		- first stopChar or NUL
+		ScanName		- first byte that is not XMLUtil::IsNameChar() (no line count)
+	The vector versions only load aligned blocks: a block never crosses a page, so
+	reading past the terminating NUL inside the last block is safe, and the bytes
+	before p in the first block are shifted out of the masks.
+*/
+#ifndef TIXML_SIMD_SSE2
+static const char* ScanWhiteSpaceScalar( const char* p, int* curLineNumPtr )
+{
+    while( XMLUtil::IsWhiteSpace( *p ) ) {
+        if ( curLineNumPtr && *p == '\n' ) {
+            ++(*curLineNumPtr);
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const char* ScanTextScalar( const char* p, char stopChar, int* curLineNumPtr )
+{
+    while ( *p && *p != stopChar ) {
+        if ( curLineNumPtr && *p == '\n' ) {
+            ++(*curLineNumPtr);
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const char* ScanNameScalar( const char* p )
+{
+    while ( *p && XMLUtil::IsNameChar( *p ) ) {
+        ++p;
+    }
+    return p;
+}
+#else
+// The scanners must not trip AddressSanitizer on the aligned reads past the NUL
+#if defined(__clang__) || (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 8))
+#   define TIXML_SCAN_BLOCKS __attribute__((no_sanitize_address))
+#else
+#   define TIXML_SCAN_BLOCKS
+#endif
+
+static inline void CountLines( unsigned newlines, int* curLineNumPtr )
+{
+    if ( curLineNumPtr ) {
+        *curLineNumPtr += __builtin_popcount( newlines );
+    }
+}
+
+TIXML_SCAN_BLOCKS
+static const char* ScanWhiteSpaceSSE2( const char* p, int* curLineNumPtr )
+{
+    const __m128i space = _mm_set1_epi8( ' ' );
+    const __m128i belowTab = _mm_set1_epi8( '\t' - 1 );
+    const __m128i aboveCR = _mm_set1_epi8( '\r' + 1 );
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    const char* block = reinterpret_cast<const char*>( reinterpret_cast<size_t>( p ) & ~size_t( 15 ) );
+    unsigned skip = static_cast<unsigned>( p - block );
+    for( ;; block += 16, skip = 0 ) {
+        const __m128i c = _mm_load_si128( reinterpret_cast<const __m128i*>( block ) );
+        // \t \n \v \f \r or space; bytes from 0x80 compare negative and are not white space
+        const __m128i ws = _mm_or_si128( _mm_cmpeq_epi8( c, space ),
+                                         _mm_and_si128( _mm_cmpgt_epi8( c, belowTab ), _mm_cmplt_epi8( c, aboveCR ) ) );
+        const unsigned stop = ( ~static_cast<unsigned>( _mm_movemask_epi8( ws ) ) & 0xffffU ) >> skip << skip;
+        const unsigned newlines = static_cast<unsigned>( _mm_movemask_epi8( _mm_cmpeq_epi8( c, newline ) ) ) >> skip << skip;
+        if ( stop ) {
+            const unsigned at = __builtin_ctz( stop );
+            CountLines( newlines & ( ( 1U << at ) - 1 ), curLineNumPtr );
+            return block + at;
+        }
+        CountLines( newlines, curLineNumPtr );
+    }
+}
+
+TIXML_SCAN_BLOCKS
+static const char* ScanTextSSE2( const char* p, char stopChar, int* curLineNumPtr )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i stopper = _mm_set1_epi8( stopChar );
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    const char* block = reinterpret_cast<const char*>( reinterpret_cast<size_t>( p ) & ~size_t( 15 ) );
+    unsigned skip = static_cast<unsigned>( p - block );
+    for( ;; block += 16, skip = 0 ) {
+        const __m128i c = _mm_load_si128( reinterpret_cast<const __m128i*>( block ) );
+        const unsigned stop = static_cast<unsigned>( _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( c, stopper ), _mm_cmpeq_epi8( c, zero ) ) ) ) >> skip << skip;
+        const unsigned newlines = static_cast<unsigned>( _mm_movemask_epi8( _mm_cmpeq_epi8( c, newline ) ) ) >> skip << skip;
+        if ( stop ) {
+            const unsigned at = __builtin_ctz( stop );
+            CountLines( newlines & ( ( 1U << at ) - 1 ), curLineNumPtr );
+            return block + at;
+        }
+        CountLines( newlines, curLineNumPtr );
+    }
+}
+
+TIXML_SCAN_BLOCKS
+static const char* ScanNameSSE2( const char* p )
+{
+    const __m128i lowerCase = _mm_set1_epi8( 0x20 );
+    const __m128i belowA = _mm_set1_epi8( 'a' - 1 );
+    const __m128i aboveZ = _mm_set1_epi8( 'z' + 1 );
+    const __m128i belowDigit = _mm_set1_epi8( '0' - 1 );
+    const __m128i aboveColon = _mm_set1_epi8( ':' + 1 );
+    const __m128i belowDash = _mm_set1_epi8( '-' - 1 );
+    const __m128i aboveDot = _mm_set1_epi8( '.' + 1 );
+    const __m128i underscore = _mm_set1_epi8( '_' );
+    const char* block = reinterpret_cast<const char*>( reinterpret_cast<size_t>( p ) & ~size_t( 15 ) );
+    unsigned skip = static_cast<unsigned>( p - block );
+    for( ;; block += 16, skip = 0 ) {
+        const __m128i c = _mm_load_si128( reinterpret_cast<const __m128i*>( block ) );
+        const __m128i folded = _mm_or_si128( c, lowerCase );
+        // letters, 0-9 and ':', '-' and '.', '_'; the sign bit (0x80 and up) counts as a name byte
+        const __m128i name = _mm_or_si128(
+            _mm_or_si128( _mm_and_si128( _mm_cmpgt_epi8( folded, belowA ), _mm_cmplt_epi8( folded, aboveZ ) ),
+                          _mm_and_si128( _mm_cmpgt_epi8( c, belowDigit ), _mm_cmplt_epi8( c, aboveColon ) ) ),
+            _mm_or_si128( _mm_and_si128( _mm_cmpgt_epi8( c, belowDash ), _mm_cmplt_epi8( c, aboveDot ) ),
+                          _mm_cmpeq_epi8( c, underscore ) ) );
+        const unsigned stop = ( ~static_cast<unsigned>( _mm_movemask_epi8( name ) | _mm_movemask_epi8( c ) ) & 0xffffU ) >> skip << skip;
+        if ( stop ) {
+            return block + __builtin_ctz( stop );
+        }
+    }
+}
+#endif
+
+#ifdef TIXML_SIMD_AVX2
+// Picked once at run time when the CPU has AVX2
+struct Scanners {
+    const char* (*whiteSpace)( const char* p, int* curLineNumPtr );
+    const char* (*text)( const char* p, char stopChar, int* curLineNumPtr );
+    const char* (*name)( const char* p );
+};
+
+TIXML_SCAN_BLOCKS __attribute__((target("avx2")))
+static const char* ScanWhiteSpaceAVX2( const char* p, int* curLineNumPtr )
+{
+    const __m256i space = _mm256_set1_epi8( ' ' );
+    const __m256i belowTab = _mm256_set1_epi8( '\t' - 1 );
+    const __m256i aboveCR = _mm256_set1_epi8( '\r' + 1 );
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+    const char* block = reinterpret_cast<const char*>( reinterpret_cast<size_t>( p ) & ~size_t( 31 ) );
+    unsigned skip = static_cast<unsigned>( p - block );
+    for( ;; block += 32, skip = 0 ) {
+        const __m256i c = _mm256_load_si256( reinterpret_cast<const __m256i*>( block ) );
+        const __m256i ws = _mm256_or_si256( _mm256_cmpeq_epi8( c, space ),
+                                            _mm256_and_si256( _mm256_cmpgt_epi8( c, belowTab ), _mm256_cmpgt_epi8( aboveCR, c ) ) );
+        const unsigned stop = ~static_cast<unsigned>( _mm256_movemask_epi8( ws ) ) >> skip << skip;
+        const unsigned newlines = static_cast<unsigned>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( c, newline ) ) ) >> skip << skip;
+        if ( stop ) {
+            const unsigned at = __builtin_ctz( stop );
+            CountLines( newlines & ( ( 1U << at ) - 1 ), curLineNumPtr );
+            return block + at;
+        }
+        CountLines( newlines, curLineNumPtr );
+    }
+}
+
+TIXML_SCAN_BLOCKS __attribute__((target("avx2")))
+static const char* ScanTextAVX2( const char* p, char stopChar, int* curLineNumPtr )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i stopper = _mm256_set1_epi8( stopChar );
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+    const char* block = reinterpret_cast<const char*>( reinterpret_cast<size_t>( p ) & ~size_t( 31 ) );
+    unsigned skip = static_cast<unsigned>( p - block );
+    for( ;; block += 32, skip = 0 ) {
+        const __m256i c = _mm256_load_si256( reinterpret_cast<const __m256i*>( block ) );
+        const unsigned stop = static_cast<unsigned>( _mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpeq_epi8( c, stopper ), _mm256_cmpeq_epi8( c, zero ) ) ) ) >> skip << skip;
+        const unsigned newlines = static_cast<unsigned>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( c, newline ) ) ) >> skip << skip;
+        if ( stop ) {
+            const unsigned at = __builtin_ctz( stop );
+            CountLines( newlines & ( ( 1U << at ) - 1 ), curLineNumPtr );
+            return block + at;
+        }
+        CountLines( newlines, curLineNumPtr );
+    }
+}
+
+TIXML_SCAN_BLOCKS __attribute__((target("avx2")))
+static const char* ScanNameAVX2( const char* p )
+{
+    const __m256i lowerCase = _mm256_set1_epi8( 0x20 );
+    const __m256i belowA = _mm256_set1_epi8( 'a' - 1 );
+    const __m256i aboveZ = _mm256_set1_epi8( 'z' + 1 );
+    const __m256i belowDigit = _mm256_set1_epi8( '0' - 1 );
+    const __m256i aboveColon = _mm256_set1_epi8( ':' + 1 );
+    const __m256i belowDash = _mm256_set1_epi8( '-' - 1 );
+    const __m256i aboveDot = _mm256_set1_epi8( '.' + 1 );
+    const __m256i underscore = _mm256_set1_epi8( '_' );
+    const char* block = reinterpret_cast<const char*>( reinterpret_cast<size_t>( p ) & ~size_t( 31 ) );
+    unsigned skip = static_cast<unsigned>( p - block );
+    for( ;; block += 32, skip = 0 ) {
+        const __m256i c = _mm256_load_si256( reinterpret_cast<const __m256i*>( block ) );
+        const __m256i folded = _mm256_or_si256( c, lowerCase );
+        const __m256i name = _mm256_or_si256(
+            _mm256_or_si256( _mm256_and_si256( _mm256_cmpgt_epi8( folded, belowA ), _mm256_cmpgt_epi8( aboveZ, folded ) ),
+                             _mm256_and_si256( _mm256_cmpgt_epi8( c, belowDigit ), _mm256_cmpgt_epi8( aboveColon, c ) ) ),
+            _mm256_or_si256( _mm256_and_si256( _mm256_cmpgt_epi8( c, belowDash ), _mm256_cmpgt_epi8( aboveDot, c ) ),
+                             _mm256_cmpeq_epi8( c, underscore ) ) );
+        const unsigned stop = ~static_cast<unsigned>( _mm256_movemask_epi8( name ) | _mm256_movemask_epi8( c ) ) >> skip << skip;
+        if ( stop ) {
+            return block + __builtin_ctz( stop );
+        }
+    }
+}
+#endif
+
+#ifdef TIXML_SIMD_AVX2
+static Scanners SelectScanners()
+{
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+        const Scanners avx2 = { ScanWhiteSpaceAVX2, ScanTextAVX2, ScanNameAVX2 };
+        return avx2;
+    }
+    const Scanners sse2 = { ScanWhiteSpaceSSE2, ScanTextSSE2, ScanNameSSE2 };
+    return sse2;
+}
+
+static const Scanners& GetScanners()
+{
+    static const Scanners scanners = SelectScanners();
+    return scanners;
+}
+
+static inline const char* ScanWhiteSpace( const char* p, int* curLineNumPtr )	{ return GetScanners().whiteSpace( p, curLineNumPtr ); }
+static inline const char* ScanText( const char* p, char stopChar, int* curLineNumPtr )	{ return GetScanners().text( p, stopChar, curLineNumPtr ); }
+static inline const char* ScanName( const char* p )	{ return GetScanners().name( p ); }
+#elif defined(TIXML_SIMD_SSE2)
+static inline const char* ScanWhiteSpace( const char* p, int* curLineNumPtr )	{ return ScanWhiteSpaceSSE2( p, curLineNumPtr ); }
+static inline const char* ScanText( const char* p, char stopChar, int* curLineNumPtr )	{ return ScanTextSSE2( p, stopChar, curLineNumPtr ); }
+static inline const char* ScanName( const char* p )	{ return ScanNameSSE2( p ); }
+#else
+static inline const char* ScanWhiteSpace( const char* p, int* curLineNumPtr )	{ return ScanWhiteSpaceScalar( p, curLineNumPtr ); }
+static inline const char* ScanText( const char* p, char stopChar, int* curLineNumPtr )	{ return ScanTextScalar( p, stopChar, curLineNumPtr ); }
+static inline const char* ScanName( const char* p )	{ return ScanNameScalar( p ); }
+#endif
+
+
 StrPair::~StrPair()
 {
     Reset();
@@ -159,10 +416,12 @@ void StrPair::TransferTo( StrPair* other )
     other->_flags = _flags;
     other->_start = _start;
     other->_end = _end;
+    other->_hash = _hash;
 
     _flags = 0;
     _start = 0;
     _end = 0;
+    _hash = 0;
 }
 
 
@@ -174,6 +433,7 @@ void StrPair::Reset()
     _flags = 0;
     _start = 0;
     _end = 0;
+    _hash = 0;
 }
 
 
@@ -200,9 +460,9 @@ char* StrPair::ParseText( char* p, const char* endTag, int strFlags, int* curLin
     char  endChar = *endTag;
     size_t length = strlen( endTag );
 
-    // Inner loop of text parsing.
-    while ( *p ) {
-        if ( *p == endChar && strncmp( p, endTag, length ) == 0 ) {
+    // Inner loop of text parsing: jump to the next endChar
+    for ( p = const_cast<char*>( ScanText( p, endChar, curLineNumPtr ) ); *p; p = const_cast<char*>( ScanText( p, endChar, curLineNumPtr ) ) ) {
+        if ( length == 1 || strncmp( p, endTag, length ) == 0 ) {
             Set( start, p, strFlags );
             return p + length;
         } else if (*p == '\n') {
@@ -225,16 +485,67 @@ char* StrPair::ParseName( char* p )
     }
 
     char* const start = p;
-    ++p;
-    while ( *p && XMLUtil::IsNameChar( *p ) ) {
-        ++p;
-    }
+    p = const_cast<char*>( ScanName( p + 1 ) );
 
     Set( start, p, 0 );
+    _hash = XMLUtil::HashName( start, p );
     return p;
 }
 
 
+unsigned StrPair::HashStr()
+{
+    const char* const str = GetStr();
+    _hash = XMLUtil::HashName( str ? str : "" );
+    return _hash;
+}
+
+
+unsigned XMLUtil::HashName( const char* start, const char* end )
+{
+    // Names are short: the length and the (overlapping) first and last 8 bytes,
+    // or fewer for shorter names, are enough to tell them apart
+    TIXMLASSERT( start <= end );
+    const size_t length = static_cast<size_t>( end - start );
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    if ( length >= 8 ) {
+        memcpy( &head, start, 8 );
+        memcpy( &tail, end - 8, 8 );
+    }
+    else if ( length >= 4 ) {
+        uint32_t head4, tail4;
+        memcpy( &head4, start, 4 );
+        memcpy( &tail4, end - 4, 4 );
+        head = head4;
+        tail = tail4;
+    }
+    else if ( length > 0 ) {
+        head = static_cast<unsigned char>( start[0] )
+               | ( static_cast<unsigned char>( start[length / 2] ) << 8 )
+               | ( static_cast<unsigned char>( end[-1] ) << 16 );
+    }
+    // One multiply: every input bit reaches the high half of the product
+    const uint64_t h = ( head ^ ( ( tail << 29 ) | ( tail >> 35 ) ) ^ length ) * 0x9e3779b97f4a7c15ULL;
+    const unsigned hash = static_cast<unsigned>( h >> 32 );
+    return hash ? hash : 1;
+}
+
+
+const char* XMLUtil::SkipWhiteSpaceRun( const char* p, int* curLineNumPtr )
+{
+    // A single blank or line end between tags is the common case, not worth a vector scan
+    if ( curLineNumPtr && *p == '\n' ) {
+        ++(*curLineNumPtr);
+    }
+    ++p;
+    if ( !IsWhiteSpace( *p ) ) {
+        return p;
+    }
+    return ScanWhiteSpace( p, curLineNumPtr );
+}
+
+
 void StrPair::CollapseWhitespace()
 {
     // Adjusting _start would cause undefined behavior on delete[]
@@ -949,6 +1260,18 @@ const XMLElement* XMLNode::FirstChildElement( const char* name ) const
 }
 
 
+const XMLElement* XMLNode::FirstChildElement( const XMLName& name ) const
+{
+    for( const XMLNode* node = _firstChild; node; node = node->_next ) {
+        const XMLElement* element = node->ToElementWithName( name );
+        if ( element ) {
+            return element;
+        }
+    }
+    return 0;
+}
+
+
 const XMLElement* XMLNode::LastChildElement( const char* name ) const
 {
     for( const XMLNode* node = _lastChild; node; node = node->_prev ) {
@@ -973,6 +1296,18 @@ const XMLElement* XMLNode::NextSiblingElement( const char* name ) const
 }
 
 
+const XMLElement* XMLNode::NextSiblingElement( const XMLName& name ) const
+{
+    for( const XMLNode* node = _next; node; node = node->_next ) {
+        const XMLElement* element = node->ToElementWithName( name );
+        if ( element ) {
+            return element;
+        }
+    }
+    return 0;
+}
+
+
 const XMLElement* XMLNode::PreviousSiblingElement( const char* name ) const
 {
     for( const XMLNode* node = _prev; node; node = node->_prev ) {
@@ -1129,6 +1464,18 @@ const XMLElement* XMLNode::ToElementWithName( const char* name ) const
     return 0;
 }
 
+const XMLElement* XMLNode::ToElementWithName( const XMLName& name ) const
+{
+    const XMLElement* element = this->ToElement();
+    if ( element == 0 ) {
+        return 0;
+    }
+    if ( element->_value.NameHash() == name.Hash() && element->_value.NameEqual( name.Name(), name.Length() ) ) {
+       return element;
+    }
+    return 0;
+}
+
 // --------- XMLText ---------- //
 char* XMLText::ParseDeep( char* p, StrPair*, int* curLineNumPtr )
 {
@@ -1509,6 +1856,17 @@ const XMLAttribute* XMLElement::FindAttribute( const char* name ) const
 }
 
 
+const XMLAttribute* XMLElement::FindAttribute( const XMLName& name ) const
+{
+    for( XMLAttribute* a = _rootAttribute; a; a = a->_next ) {
+        if ( a->_name.NameHash() == name.Hash() && a->_name.NameEqual( name.Name(), name.Length() ) ) {
+            return a;
+        }
+    }
+    return 0;
+}
+
+
 const char* XMLElement::Attribute( const char* name, const char* value ) const
 {
     const XMLAttribute* a = FindAttribute( name );
@@ -1521,6 +1879,19 @@ const char* XMLElement::Attribute( const char* name, const char* value ) const
     return 0;
 }
 
+
+const char* XMLElement::Attribute( const XMLName& name, const char* value ) const
+{
+    const XMLAttribute* a = FindAttribute( name );
+    if ( !a ) {
+        return 0;
+    }
+    if ( !value || XMLUtil::StringEqual( a->Value(), value )) {
+        return a->Value();
+    }
+    return 0;
+}
+
 int XMLElement::IntAttribute(const char* name, int defaultValue) const 
 {
 	int i = defaultValue;
@@ -1819,7 +2190,7 @@ char* XMLElement::ParseAttributes( char* p, int* curLineNumPtr )
             int attrLineNum = attrib->_parseLineNum;
 
             p = attrib->ParseDeep( p, _document->ProcessEntities(), curLineNumPtr );
-            if ( !p || Attribute( attrib->Name() ) ) {
+            if ( !p || FindAttribute( XMLName( attrib->Name(), attrib->_name.NameHash() ) ) ) {
                 DeleteAttribute( attrib );
                 _document->SetError( XML_ERROR_PARSING_ATTRIBUTE, attrLineNum, "XMLElement name=%s", Name() );
                 return 0;
@@ -1999,6 +2370,8 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
     _errorStr(),
     _errorLineNum( 0 ),
     _charBuffer( 0 ),
+    _charBufferSize( 0 ),
+    _reuseMemory( false ),
     _parseCurLineNum( 0 ),
     _unlinked(),
     _elementPool(),
@@ -2013,6 +2386,7 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespaceMode ) :
 
 XMLDocument::~XMLDocument()
 {
+    _reuseMemory = false;	// release the kept character buffer too
     Clear();
 }
 
@@ -2042,8 +2416,11 @@ void XMLDocument::Clear()
 #endif
     ClearError();
 
-    delete [] _charBuffer;
-    _charBuffer = 0;
+    if ( !_reuseMemory ) {
+        delete [] _charBuffer;
+        _charBuffer = 0;
+        _charBufferSize = 0;
+    }
 
 #if 0
     _textPool.Trace( "text" );
@@ -2060,6 +2437,31 @@ void XMLDocument::Clear()
         TIXMLASSERT( _commentPool.CurrentAllocs()   == _commentPool.Untracked() );
     }
 #endif
+    if ( _reuseMemory ) {
+        ResetPools();
+    }
+}
+
+
+void XMLDocument::AllocCharBuffer( size_t size )
+{
+    if ( _charBuffer && _charBufferSize >= size ) {
+        return;
+    }
+    delete [] _charBuffer;
+    _charBuffer = 0;
+    _charBuffer = new char[size];
+    _charBufferSize = size;
+}
+
+
+void XMLDocument::ResetPools()
+{
+    // Every node is gone: hand the whole pools out again, in order
+    _elementPool.Reset();
+    _attributePool.Reset();
+    _textPool.Reset();
+    _commentPool.Reset();
 }
 
 
@@ -2216,8 +2618,8 @@ XMLError XMLDocument::LoadFile( FILE* fp )
     }
 
     const size_t size = filelength;
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[size+1];
+    TIXMLASSERT( _reuseMemory || _charBuffer == 0 );
+    AllocCharBuffer( size+1 );
     size_t read = fread( _charBuffer, 1, size, fp );
     if ( read != size ) {
         SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
@@ -2266,8 +2668,8 @@ XMLError XMLDocument::Parse( const char* p, size_t len )
     if ( len == (size_t)(-1) ) {
         len = strlen( p );
     }
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[ len+1 ];
+    TIXMLASSERT( _reuseMemory || _charBuffer == 0 );
+    AllocCharBuffer( len+1 );
     memcpy( _charBuffer, p, len );
     _charBuffer[len] = 0;
 
@@ -2277,10 +2679,19 @@ XMLError XMLDocument::Parse( const char* p, size_t len )
         // and the parse fail can put objects in the
         // pools that are dead and inaccessible.
         DeleteChildren();
-        _elementPool.Clear();
-        _attributePool.Clear();
-        _textPool.Clear();
-        _commentPool.Clear();
+        if ( _reuseMemory ) {
+            // Keep the blocks, but nothing may point into them any more
+            while( _unlinked.Size()) {
+                DeleteNode(_unlinked[0]);
+            }
+            ResetPools();
+        }
+        else {
+            _elementPool.Clear();
+            _attributePool.Clear();
+            _textPool.Clear();
+            _commentPool.Clear();
+        }
     }
     return _errorID;
 }
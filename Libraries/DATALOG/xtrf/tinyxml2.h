@@ -135,7 +135,7 @@ public:
         COMMENT							= NEEDS_NEWLINE_NORMALIZATION
     };
 
-    StrPair() : _flags( 0 ), _start( 0 ), _end( 0 ) {}
+    StrPair() : _flags( 0 ), _start( 0 ), _end( 0 ), _hash( 0 ) {}
     ~StrPair();
 
     void Set( char* start, char* end, int flags ) {
@@ -163,11 +163,24 @@ public:
     char* ParseText( char* in, const char* endTag, int strFlags, int* curLineNumPtr );
     char* ParseName( char* in );
 
+    // XMLUtil::HashName() of the string: kept from ParseName(), computed on first use otherwise
+    unsigned NameHash() {
+        return _hash ? _hash : HashStr();
+    }
+    // Names only, they have nothing to unescape: compared in place, without flushing the string
+    bool NameEqual( const char* name, size_t length ) const {
+        if ( _end ) {
+            return static_cast<size_t>( _end - _start ) == length && memcmp( _start, name, length ) == 0;
+        }
+        return _start && strcmp( _start, name ) == 0;   // interned
+    }
+
     void TransferTo( StrPair* other );
 	void Reset();
 
 private:
     void CollapseWhitespace();
+    unsigned HashStr();
 
     enum {
         NEEDS_FLUSH = 0x100,
@@ -177,6 +190,7 @@ private:
     int     _flags;
     char*   _start;
     char*   _end;
+    unsigned _hash;     // 0 until known
 
     StrPair( const StrPair& other );	// not supported
     void operator=( StrPair& other );	// not supported, use TransferTo()
@@ -352,6 +366,21 @@ public:
         _nUntracked = 0;
     }
 
+    // Puts every item of every block back on the free list, in block order, and
+    // keeps the blocks. Only valid once nothing allocated from the pool is in use.
+    void Reset() {
+        _root = 0;
+        for( int b = _blockPtrs.Size() - 1; b >= 0; --b ) {
+            Item* blockItems = _blockPtrs[b]->items;
+            for( int i = ITEMS_PER_BLOCK - 1; i >= 0; --i ) {
+                blockItems[i].next = _root;
+                _root = &blockItems[i];
+            }
+        }
+        _currentAllocs = 0;
+        _nUntracked = 0;
+    }
+
     virtual int ItemSize() const	{
         return ITEM_SIZE;
     }
@@ -542,11 +571,9 @@ public:
     static const char* SkipWhiteSpace( const char* p, int* curLineNumPtr )	{
         TIXMLASSERT( p );
 
-        while( IsWhiteSpace(*p) ) {
-            if (curLineNumPtr && *p == '\n') {
-                ++(*curLineNumPtr);
-            }
-            ++p;
+        // Mostly there is nothing to skip; runs (indentation) are scanned a block at a time
+        if ( IsWhiteSpace(*p) ) {
+            p = SkipWhiteSpaceRun( p, curLineNumPtr );
         }
         TIXMLASSERT( p );
         return p;
@@ -554,6 +581,7 @@ public:
     static char* SkipWhiteSpace( char* p, int* curLineNumPtr )				{
         return const_cast<char*>( SkipWhiteSpace( const_cast<const char*>(p), curLineNumPtr ) );
     }
+    static const char* SkipWhiteSpaceRun( const char* p, int* curLineNumPtr );
 
     // Anything in the high order range of UTF-8 is assumed to not be whitespace. This isn't
     // correct, but simple, and usually works.
@@ -593,6 +621,14 @@ public:
         return ( p & 0x80 ) != 0;
     }
 
+    // Hash of the name [start, end), never 0. Equal names hash equal; different
+    // names usually do not, a matching hash is confirmed with a string compare.
+    static unsigned HashName( const char* start, const char* end );
+    static unsigned HashName( const char* name )	{
+        TIXMLASSERT( name );
+        return HashName( name, name + strlen( name ) );
+    }
+
     static const char* ReadBOM( const char* p, bool* hasBOM );
     // p is the starting location,
     // the UTF-8 value of the entity will be placed in value, and length filled in.
@@ -628,6 +664,36 @@ private:
 };
 
 
+/** An element or attribute name with its hash computed once, for the lookups
+	done over and over with the same name. Names in a parsed document are hashed
+	while parsing, so a lookup by XMLName compares integers and only confirms a
+	hit with a string compare. The string is not copied and must outlive the
+	XMLName, a string literal typically:
+
+	@verbatim
+	static const XMLName childName( "Child" );
+	for( XMLElement* child = element->FirstChildElement( childName ); child; child = child->NextSiblingElement( childName ) )
+	@endverbatim
+*/
+class TINYXML2_LIB XMLName
+{
+public:
+    explicit XMLName( const char* name ) : _name( name ), _length( strlen( name ) ), _hash( XMLUtil::HashName( name, name + _length ) ) {}
+
+    const char* Name() const	{ return _name; }
+    size_t Length() const		{ return _length; }
+    unsigned Hash() const		{ return _hash; }
+
+private:
+    friend class XMLElement;
+    XMLName( const char* name, unsigned hash ) : _name( name ), _length( strlen( name ) ), _hash( hash ) {}
+
+    const char* _name;
+    size_t _length;
+    unsigned _hash;
+};
+
+
 /** XMLNode is a base class for every object that is in the
 	XML Document Object Model (DOM), except XMLAttributes.
 	Nodes have siblings, a parent, and children which can
@@ -764,6 +830,12 @@ public:
     XMLElement* FirstChildElement( const char* name = 0 )	{
         return const_cast<XMLElement*>(const_cast<const XMLNode*>(this)->FirstChildElement( name ));
     }
+    /// Get the first child element with the given name, compared by its hash.
+    const XMLElement* FirstChildElement( const XMLName& name ) const;
+
+    XMLElement* FirstChildElement( const XMLName& name )	{
+        return const_cast<XMLElement*>(const_cast<const XMLNode*>(this)->FirstChildElement( name ));
+    }
 
     /// Get the last child node, or null if none exists.
     const XMLNode*	LastChild() const						{
@@ -814,6 +886,12 @@ public:
     XMLElement*	NextSiblingElement( const char* name = 0 )	{
         return const_cast<XMLElement*>(const_cast<const XMLNode*>(this)->NextSiblingElement( name ) );
     }
+    /// Get the next sibling element with the given name, compared by its hash.
+    const XMLElement*	NextSiblingElement( const XMLName& name ) const;
+
+    XMLElement*	NextSiblingElement( const XMLName& name )	{
+        return const_cast<XMLElement*>(const_cast<const XMLNode*>(this)->NextSiblingElement( name ) );
+    }
 
     /**
     	Add a child node as the last (right) child.
@@ -952,6 +1030,7 @@ private:
     static void DeleteNode( XMLNode* node );
     void InsertChildPreamble( XMLNode* insertThis ) const;
     const XMLElement* ToElementWithName( const char* name ) const;
+    const XMLElement* ToElementWithName( const XMLName& name ) const;
 
     XMLNode( const XMLNode& );	// not supported
     XMLNode& operator=( const XMLNode& );	// not supported
@@ -1278,6 +1357,8 @@ public:
     	@endverbatim
     */
     const char* Attribute( const char* name, const char* value=0 ) const;
+    /// Attribute() with the name compared by its hash.
+    const char* Attribute( const XMLName& name, const char* value=0 ) const;
 
     /** Given an attribute name, IntAttribute() returns the value
     	of the attribute interpreted as an integer. The default
@@ -1452,6 +1533,8 @@ public:
     }
     /// Query a specific attribute in the list.
     const XMLAttribute* FindAttribute( const char* name ) const;
+    /// Query a specific attribute in the list, its name compared by its hash.
+    const XMLAttribute* FindAttribute( const XMLName& name ) const;
 
     /** Convenience function for easy access to the text inside an element. Although easy
     	and concise, GetText() is limited compared to getting the XMLText child
@@ -1723,6 +1806,19 @@ public:
         _writeBOM = useBOM;
     }
 
+    /**
+    	Long-lived document mode. When set, Clear() - and so every Parse()
+    	and LoadFile() - keeps the node pools and the character buffer for
+    	the next document instead of releasing them, so parsing documents of
+    	similar size again does not allocate. Off by default.
+    */
+    void SetReuseMemory( bool reuse ) {
+        _reuseMemory = reuse;
+    }
+    bool ReuseMemory() const {
+        return _reuseMemory;
+    }
+
     /** Return the root element of DOM. Equivalent to FirstChildElement().
         To get the first node, use FirstChild().
     */
@@ -1858,6 +1954,8 @@ private:
     mutable StrPair	_errorStr;
     int             _errorLineNum;
     char*			_charBuffer;
+    size_t			_charBufferSize;
+    bool			_reuseMemory;
     int				_parseCurLineNum;
 	// Memory tracking does add some overhead.
 	// However, the code assumes that you don't
@@ -1875,6 +1973,8 @@ private:
 	static const char* _errorNames[XML_ERROR_COUNT];
 
     void Parse();
+    void AllocCharBuffer( size_t size );
+    void ResetPools();
 
     void SetError( XMLError error, int lineNum, const char* format, ... );
 
@@ -4,7 +4,27 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <iterator>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <system_error>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <glob.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <csignal>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <cctype>
 #include <cstring> // for strerror
 #include <cerrno>  // for errno
 
@@ -17,32 +37,236 @@ Xtrf* Xtrf::instance() {
 	return &l_instance;
 }
 
-void Xtrf::set(const std::string& token, const std::string& value) {
-	m_stdFields[token] = value;
+// Names of the known tokens, in XtrfTokenId order
+static const char* const knownTokenNames[XTRF_NUM_KNOWN_TOKENS] = {
+	"MIR.SETUP_T", "MIR.START_T", "MIR.STAT_NUM", "MIR.MODE_COD", "MIR.RTST_COD", "MIR.PROT_COD",
+	"MIR.BURN_TIM", "MIR.CMOD_COD", "MIR.LOT_ID", "MIR.PART_TYP", "MIR.NODE_NAM", "MIR.TSTR_TYP",
+	"MIR.JOB_NAM", "MIR.JOB_REV", "MIR.SBLOT_ID", "MIR.OPER_NAM", "MIR.EXEC_TYP", "MIR.EXEC_VER",
+	"MIR.TEST_COD", "MIR.TST_TEMP", "MIR.USER_TXT", "MIR.AUX_FILE", "MIR.PKG_TYP", "MIR.FAMLY_ID",
+	"MIR.DATE_COD", "MIR.FACIL_ID", "MIR.FLOOR_ID", "MIR.PROC_ID", "MIR.OPER_FRQ", "MIR.SPEC_NAM",
+	"MIR.SPEC_VER", "MIR.FLOW_ID", "MIR.SETUP_ID", "MIR.DSGN_REV", "MIR.ENG_ID", "MIR.ROM_COD",
+	"MIR.SERL_NUM", "MIR.SUPR_NAM",
+	"SDR.HEAD_NUM", "SDR.SITE_GRP", "SDR.HAND_TYP", "SDR.HAND_ID", "SDR.CARD_TYP", "SDR.CARD_ID",
+	"SDR.LOAD_TYP", "SDR.LOAD_ID", "SDR.DIB_TYP", "SDR.DIB_ID", "SDR.CABL_TYP", "SDR.CABL_ID",
+	"SDR.CONT_TYP", "SDR.CONT_ID", "SDR.LASR_TYP", "SDR.LASR_ID", "SDR.EXTR_TYP", "SDR.EXTR_ID",
+	"MRR.FINISH_T", "MRR.DISP_COD", "MRR.USR_DESC", "MRR.EXC_DESC"
+};
+
+/**
+ * Token name <-> id. The known tokens are a sorted flat array, fixed once
+ * built. Other names get the next ids as they are interned; that part is
+ * shared by every Xtrf and locked.
+ */
+class XtrfTokenTable {
+public:
+	XtrfTokenTable();
+
+	int find(const std::string& token);
+	int intern(const std::string& token);
+	const std::string& name(int id);
+
+	static XtrfTokenTable& instance();
+
+private:
+	typedef std::pair< std::string, int > Entry;
+
+	std::vector< Entry > m_known;              /** sorted by name */
+	std::vector< std::string > m_knownNames;   /** by id */
+	std::unordered_map< std::string, int > m_extra;
+	std::deque< std::string > m_extraNames;    /** by id - XTRF_NUM_KNOWN_TOKENS */
+	std::mutex m_mutex;
+
+	int findKnown(const std::string& token) const;
+	static bool lessName(const Entry& entry, const std::string& token) { return entry.first < token; }
+};
+
+XtrfTokenTable::XtrfTokenTable() :
+	m_known(), m_knownNames(knownTokenNames, knownTokenNames + XTRF_NUM_KNOWN_TOKENS), m_extra(), m_extraNames(), m_mutex() {
+	for(int id = 0; id < XTRF_NUM_KNOWN_TOKENS; ++id) {
+		m_known.push_back(Entry(m_knownNames[id], id));
+	}
+	std::sort(m_known.begin(), m_known.end());
+}
+
+XtrfTokenTable& XtrfTokenTable::instance() {
+	static XtrfTokenTable l_instance;
+	return l_instance;
+}
+
+int XtrfTokenTable::findKnown(const std::string& token) const {
+	std::vector< Entry >::const_iterator itr = std::lower_bound(m_known.begin(), m_known.end(), token, lessName);
+	return (itr != m_known.end() && itr->first == token) ? itr->second : -1;
+}
+
+int XtrfTokenTable::find(const std::string& token) {
+	const int id = findKnown(token);
+	if(id >= 0) return id;
+	std::lock_guard< std::mutex > lock(m_mutex);
+	std::unordered_map< std::string, int >::const_iterator itr = m_extra.find(token);
+	return (itr != m_extra.end()) ? itr->second : -1;
+}
+
+int XtrfTokenTable::intern(const std::string& token) {
+	const int id = findKnown(token);
+	if(id >= 0) return id;
+	std::lock_guard< std::mutex > lock(m_mutex);
+	std::unordered_map< std::string, int >::const_iterator itr = m_extra.find(token);
+	if(itr != m_extra.end()) return itr->second;
+	const int newId = XTRF_NUM_KNOWN_TOKENS + static_cast< int >(m_extraNames.size());
+	m_extraNames.push_back(token);
+	m_extra[token] = newId;
+	return newId;
+}
+
+const std::string& XtrfTokenTable::name(int id) {
+	if(id < XTRF_NUM_KNOWN_TOKENS) return m_knownNames[id];
+	std::lock_guard< std::mutex > lock(m_mutex);
+	return m_extraNames[id - XTRF_NUM_KNOWN_TOKENS];
+}
+
+int XtrfFields::find(const std::string& token) {
+	return XtrfTokenTable::instance().find(token);
+}
+
+int XtrfFields::intern(const std::string& token) {
+	return XtrfTokenTable::instance().intern(token);
+}
+
+int XtrfFields::intern(const std::string& recordName, const std::string& fieldName) {
+	std::string token;
+	token.reserve(recordName.size() + 1 + fieldName.size());
+	token.append(recordName).append(1, '.').append(fieldName);
+	return XtrfTokenTable::instance().intern(token);
+}
+
+const std::string& XtrfFields::name(int id) {
+	return XtrfTokenTable::instance().name(id);
+}
+
+const std::string* XtrfFields::find(int id) const {
+	return (id >= 0 && static_cast< size_t >(id) < m_isSet.size() && m_isSet[id]) ? &m_values[id] : NULL;
+}
+
+const std::string& XtrfFields::get(int id) const {
+	static const std::string empty;
+	const std::string* value = find(id);
+	return (NULL != value) ? *value : empty;
+}
+
+void XtrfFields::set(int id, const std::string& value) {
+	std::string copy(value);
+	swap(id, copy);
+}
+
+void XtrfFields::swap(int id, std::string& value) {
+	// value gets what was there before
+	if(static_cast< size_t >(id) >= m_values.size()) {
+		m_values.resize(id + 1);
+		m_isSet.resize(id + 1, 0);
+	}
+	if(!m_isSet[id]) {
+		m_isSet[id] = 1;
+		m_setIds.push_back(id);
+	}
+	m_values[id].swap(value);
 }
 
-const std::string Xtrf::get(const std::string& token) {
-	std::map<std::string, std::string>::const_iterator itr = m_stdFields.find(token);
-	if(itr == m_stdFields.end()) {
-		return "";
+void XtrfFields::clear() {
+	for(std::vector< int >::const_iterator id = m_setIds.begin(); id != m_setIds.end(); ++id) {
+		m_values[*id].clear();
+		m_isSet[*id] = 0;
 	}
-	return itr->second;
+	m_setIds.clear();
+}
+
+void XtrfFields::swap(XtrfFields& fields) {
+	m_values.swap(fields.m_values);
+	m_isSet.swap(fields.m_isSet);
+	m_setIds.swap(fields.m_setIds);
 }
 
+void Xtrf::set(int token, const std::string& value) {
+	m_stdFields.set(token, value);
+}
+
+const std::string& Xtrf::get(const std::string& token) {
+	return m_stdFields.get(XtrfFields::find(token));
+}
+
+GdrDataList compileGdr(const GdrRecord& gdr) {
+	// A GEN_DATA value is written only once a non zero FIELD_CNT was seen.
+	// Type names are matched the way the datalog always did: C*n exactly, the others as substrings.
+	static const char* const numericTypes[] = { "I*1", "I*2", "I*4", "U*1", "U*2", "U*4", "R*4", "R*8" };
+	static const GdrDataType numericIds[] = { GDR_I1, GDR_I2, GDR_I4, GDR_U1, GDR_U2, GDR_U4, GDR_R4, GDR_R8 };
+	GdrDataList data;
+	int fieldCount = 0;
+	for(GdrRecord::const_iterator gdrField = gdr.begin(); gdrField != gdr.end(); ++gdrField) {
+		if(gdrField->m_name == "FIELD_CNT") {
+			std::istringstream str2intStream(gdrField->m_value);
+			str2intStream >> fieldCount;
+			continue;
+		}
+		if(gdrField->m_name != "GEN_DATA" || fieldCount <= 0) continue;
+		if(gdrField->m_type == "C*n") {
+			data.push_back(GdrData(GDR_CN));
+			data.back().m_str = gdrField->m_value;
+			continue;
+		}
+		size_t typeIdx = 0;
+		while(typeIdx < sizeof(numericTypes) / sizeof(numericTypes[0])
+				&& gdrField->m_type.find(numericTypes[typeIdx]) == std::string::npos) {
+			++typeIdx;
+		}
+		if(typeIdx == sizeof(numericTypes) / sizeof(numericTypes[0])) continue;   // unsupported type, nothing written
+		GdrData value(numericIds[typeIdx]);
+		std::istringstream str2xStream(gdrField->m_value);
+		switch(value.m_type) {
+		case GDR_I1: case GDR_I2: case GDR_I4: str2xStream >> value.m_int;  break;
+		case GDR_U1: case GDR_U2: case GDR_U4: str2xStream >> value.m_uint; break;
+		default:                               str2xStream >> value.m_real; break;
+		}
+		data.push_back(value);
+	}
+	return data;
+}
+
+/**
+ * Element and attribute names of the recipes, hashed once: the DOM walk
+ * compares them with the hashes tinyxml2 took while parsing
+ */
+struct XtrfXmlNames {
+	tinyxml2::XMLName m_stdf;
+	tinyxml2::XMLName m_stdfRecord;
+	tinyxml2::XMLName m_recordName;
+	tinyxml2::XMLName m_stdfFields;
+	tinyxml2::XMLName m_stdfField;
+	tinyxml2::XMLName m_fieldName;
+	tinyxml2::XMLName m_dataType;
+
+	XtrfXmlNames() : m_stdf("STDF"), m_stdfRecord("STDFrecord"), m_recordName("recordName"), m_stdfFields("STDFfields"),
+		m_stdfField("STDFfield"), m_fieldName("fieldName"), m_dataType("dataType") {}
+
+	static const XtrfXmlNames& get() {
+		static const XtrfXmlNames names;
+		return names;
+	}
+};
+
 void Xtrf::processRecord(const char* recordName, tinyxml2::XMLElement* stdfRecordElt) {
+	const XtrfXmlNames& names(XtrfXmlNames::get());
 	// Try to get the first STDFfields.STDFfield in current testerRecipe.STDF.STDFrecord element
-	tinyxml2::XMLElement* stdfFieldElt = stdfRecordElt->FirstChildElement("STDFfields");
-	if(stdfFieldElt) stdfFieldElt = stdfFieldElt->FirstChildElement("STDFfield");
+	tinyxml2::XMLElement* stdfFieldElt = stdfRecordElt->FirstChildElement(names.m_stdfFields);
+	if(stdfFieldElt) stdfFieldElt = stdfFieldElt->FirstChildElement(names.m_stdfField);
 	//std::cout << " === " << recordName << " === " << std::endl;
 	if(strncmp("GDR", recordName, 3) == 0) {
 		GdrRecord myGdrRecord;
 		// Iterate over all STDFfields.STDFfield elements
-		for(;NULL != stdfFieldElt;stdfFieldElt = stdfFieldElt->NextSiblingElement("STDFfield")) {
+		for(;NULL != stdfFieldElt;stdfFieldElt = stdfFieldElt->NextSiblingElement(names.m_stdfField)) {
 			// If field name is not set, skip it
-			const char* fieldName  = stdfFieldElt->Attribute("fieldName");
+			const char* fieldName  = stdfFieldElt->Attribute(names.m_fieldName);
 			if(NULL == fieldName) continue;
 			// If field type is not set, skip it
-			const char* dataType  = stdfFieldElt->Attribute("dataType");
+			const char* dataType  = stdfFieldElt->Attribute(names.m_dataType);
 			if(NULL == dataType) continue;
 			// Try to get value, if there is a child. Empty childs will be ignored.
 			tinyxml2::XMLNode* textNode = stdfFieldElt->FirstChild();
@@ -53,155 +277,1783 @@ void Xtrf::processRecord(const char* recordName, tinyxml2::XMLElement* stdfRecor
 			myGdrRecord.push_back(GdrField(fieldName, dataType, dataValue));
 			//std::cout << dataType << " " <<dataValue << std::endl;
 		}
-		m_gdrRecords.push_back(myGdrRecord);
+		addGdr(myGdrRecord);
 	}
 	else {
 		// Iterate over all STDFfields.STDFfield elements
-		for(;NULL != stdfFieldElt;stdfFieldElt = stdfFieldElt->NextSiblingElement("STDFfield")) {
+		for(;NULL != stdfFieldElt;stdfFieldElt = stdfFieldElt->NextSiblingElement(names.m_stdfField)) {
 			// If field name is not set, skip it
-			const char* fieldName = stdfFieldElt->Attribute("fieldName");
+			const char* fieldName = stdfFieldElt->Attribute(names.m_fieldName);
 			if(NULL == fieldName) continue;
 			// Try to get value, if there is a child. Empty childs will be ignored.
 			tinyxml2::XMLNode* textNode = stdfFieldElt->FirstChild();
 			if(NULL == textNode) continue;
 			if(NULL == textNode->ToText()) continue;
 			const std::string stdfFieldValue(textNode->ToText()->Value());
-			std::ostringstream xtrfToken;
-			xtrfToken << recordName << "." << fieldName;
-			set(xtrfToken.str(), stdfFieldValue);
+			set(XtrfFields::intern(recordName, fieldName), stdfFieldValue);
 			//std::cout << recordName << "." << fieldName << " = " << stdfFieldValue << std::endl;
 		}
 	}
 }
 
-bool Xtrf::parse(const std::string& file) {
-	// Load XTRF document
-	tinyxml2::XMLDocument xtrfDoc;
-	tinyxml2::XMLError errCode = xtrfDoc.LoadFile(file.c_str());
-	m_errorStr = xtrfDoc.ErrorStr();
+bool XtrfFileStamp::matches(const struct stat& fileStat) const {
+	return m_device == static_cast< unsigned long >(fileStat.st_dev)
+		&& m_inode == static_cast< unsigned long >(fileStat.st_ino)
+		&& m_size == static_cast< long long >(fileStat.st_size)
+		&& m_mtimeSec == static_cast< long long >(fileStat.st_mtim.tv_sec)
+		&& m_mtimeNsec == static_cast< long >(fileStat.st_mtim.tv_nsec);
+}
+
+void XtrfFileStamp::set(const struct stat& fileStat) {
+	m_device = fileStat.st_dev;
+	m_inode = fileStat.st_ino;
+	m_size = fileStat.st_size;
+	m_mtimeSec = fileStat.st_mtim.tv_sec;
+	m_mtimeNsec = fileStat.st_mtim.tv_nsec;
+}
+
+/**
+ * Guards the accesses to mapped recipe contents. The faModule rewrites recipe
+ * files in place, and touching a mapping past the end of a file truncated
+ * since raises SIGBUS. Inside an XtrfFaultGuard such a fault on its range
+ * returns to the guard's sigsetjmp() with 1 instead; any other SIGBUS goes
+ * where it went before the handler was installed. Only code without objects
+ * to destroy may run between sigsetjmp() and the access.
+ */
+class XtrfFaultGuard {
+public:
+	XtrfFaultGuard(const char* data, size_t size);
+	~XtrfFaultGuard();
+
+	sigjmp_buf m_jump;
+
+private:
+	const char* m_begin;
+	const char* m_end;
+	XtrfFaultGuard* m_outer;
+
+	static thread_local XtrfFaultGuard* t_current;
+	static struct sigaction s_previous;
+
+	static bool install();
+	static void onBusError(int sig, siginfo_t* info, void* context);
+
+	// disable copy
+	XtrfFaultGuard(const XtrfFaultGuard&);
+	XtrfFaultGuard& operator=(const XtrfFaultGuard&);
+};
+
+thread_local XtrfFaultGuard* XtrfFaultGuard::t_current = NULL;
+struct sigaction XtrfFaultGuard::s_previous;
+
+XtrfFaultGuard::XtrfFaultGuard(const char* data, size_t size) :
+	m_jump(), m_begin(data), m_end(data + size), m_outer(t_current) {
+	static const bool installed = install();
+	(void)installed;
+	t_current = this;
+}
+
+XtrfFaultGuard::~XtrfFaultGuard() {
+	t_current = m_outer;
+}
+
+bool XtrfFaultGuard::install() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = onBusError;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	return ::sigaction(SIGBUS, &action, &s_previous) == 0;
+}
+
+void XtrfFaultGuard::onBusError(int sig, siginfo_t* info, void* context) {
+	const char* address = static_cast< const char* >(info->si_addr);
+	for(XtrfFaultGuard* guard = t_current; NULL != guard; guard = guard->m_outer) {
+		if(address >= guard->m_begin && address < guard->m_end) siglongjmp(guard->m_jump, 1);
+	}
+	// Not a recipe mapping: what would have happened without this handler
+	if(s_previous.sa_flags & SA_SIGINFO) {
+		s_previous.sa_sigaction(sig, info, context);
+	}
+	else if(s_previous.sa_handler != SIG_DFL && s_previous.sa_handler != SIG_IGN) {
+		s_previous.sa_handler(sig);
+	}
+	else {
+		// Delivered again once this returns, with the default action
+		::signal(sig, SIG_DFL);
+		::raise(sig);
+	}
+}
+
+/**
+ * Contents of a recipe file for a DOM parse. A regular file of MapThreshold
+ * bytes or more is mapped read only and private, so hashing it copies
+ * nothing and XMLDocument::Parse() copies it once, straight from the page
+ * cache. Smaller files, and files that cannot be mapped such as pipes, are
+ * read into memory. Accesses to a mapping go through an XtrfFaultGuard.
+ * Nothing refers to the contents once the parse is done.
+ */
+class XtrfContents {
+public:
+	XtrfContents();
+	~XtrfContents();
+
+	bool open(const std::string& file, struct stat& fileStat);
+	bool hash(unsigned long long& hash) const; /** false if the file shrank under the mapping */
+	inline const char* data() const { return m_data; }
+	inline size_t size() const { return m_size; }
+
+private:
+	static const size_t MapThreshold = 1 << 20;
+
+	void* m_map;
+	std::string m_read;        /** contents of a file that was not mapped */
+	const char* m_data;
+	size_t m_size;
+
+	// disable copy
+	XtrfContents(const XtrfContents&);
+	XtrfContents& operator=(const XtrfContents&);
+};
+
+XtrfContents::XtrfContents() :
+	m_map(NULL), m_read(), m_data(""), m_size(0) {}
+
+XtrfContents::~XtrfContents() {
+	if(NULL != m_map) ::munmap(m_map, m_size);
+}
+
+bool XtrfContents::open(const std::string& file, struct stat& fileStat) {
+	// The stat identity is taken from the descriptor that is read
+	const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return false;
+	bool success = (::fstat(fd, &fileStat) == 0);
+	if(success && S_ISREG(fileStat.st_mode) && fileStat.st_size >= static_cast< off_t >(MapThreshold)) {
+		void* map = ::mmap(NULL, static_cast< size_t >(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) {
+			::madvise(map, static_cast< size_t >(fileStat.st_size), MADV_SEQUENTIAL);
+			m_map = map;
+			m_data = static_cast< const char* >(map);
+			m_size = static_cast< size_t >(fileStat.st_size);
+		}
+	}
+	if(success && NULL == m_map) {
+		// Sized by the stat, read to the end whatever the file turns out to hold
+		if(S_ISREG(fileStat.st_mode) && fileStat.st_size > 0) m_read.reserve(static_cast< size_t >(fileStat.st_size));
+		char chunk[65536];
+		ssize_t got;
+		while((got = ::read(fd, chunk, sizeof(chunk))) > 0 || (got < 0 && errno == EINTR)) {
+			if(got > 0) m_read.append(chunk, static_cast< size_t >(got));
+		}
+		success = (got == 0);
+		m_data = m_read.data();
+		m_size = m_read.size();
+	}
+	const int savedErrno = errno;
+	::close(fd);
+	errno = savedErrno;
+	return success;
+}
+
+bool XtrfContents::hash(unsigned long long& hash) const {
+	// 64 bit FNV-1a
+	XtrfFaultGuard guard(m_data, m_size);
+	if(sigsetjmp(guard.m_jump, 1) != 0) return false;
+	unsigned long long value = 14695981039346656037ULL;
+	for(size_t i = 0; i < m_size; ++i) {
+		value ^= static_cast< unsigned char >(m_data[i]);
+		value *= 1099511628211ULL;
+	}
+	hash = value;
+	return true;
+}
+
+/**
+ * Pull scanner for Xtrf::parse() in PARSE_STREAM mode. It reads the file in
+ * fixed size chunks, hashing them as they are read, and fills an
+ * XtrfCacheEntry while it goes, so memory is the chunk, the open element
+ * stack and the values that are kept, whatever the recipe size. Node rules
+ * follow tinyxml2 (whitespace, entities, CDATA, first child text, end of input
+ * at a NUL byte), so both modes give the same fields and reject the same
+ * malformed documents.
+ */
+class XtrfScanner {
+public:
+	XtrfScanner(int fd);
+
+	bool scan(XtrfCacheEntry& entry);
+	unsigned long long hash();
+	inline const std::string& error() const { return m_error; }
+
+private:
+	enum Role { OTHER, ROOT, STDF, RECORD, FIELDS, FIELD };
+	enum TagEnd { TAG_ERROR, TAG_OPEN, TAG_CLOSED };
+
+	/** An open element, kept for reuse when it is closed */
+	class Frame {
+	public:
+		std::string m_name;
+		Role m_role;
+		bool m_found;          /** ROOT: STDF seen, RECORD: STDFfields seen */
+		bool m_hasChild;       /** FIELD: first child node seen */
+		bool m_isText;         /** FIELD: and it was text */
+		std::string m_value;   /** FIELD: that text */
+		std::string m_attr[2]; /** RECORD: recordName, FIELD: fieldName and dataType */
+		bool m_hasAttr[2];
+		GdrRecord m_gdr;       /** RECORD: GDR fields so far */
+	};
+
+	static const size_t ChunkSize = 65536;
+
+	int m_fd;
+	std::vector< char > m_buf;
+	size_t m_pos;
+	size_t m_end;
+	size_t m_offset;               /** file offset of m_buf[0] */
+	bool m_eof;                    /** nothing more to buffer: end of file, read error or NUL */
+	bool m_readError;
+	int m_readErrno;
+	unsigned long long m_hash;     /** FNV-1a of everything read from the file */
+	std::string m_error;
+	std::vector< Frame > m_stack;
+	size_t m_depth;
+	std::vector< std::string > m_attrNames;
+	std::string m_scratch;
+
+	size_t read(char* buf, size_t size);
+	bool fill(size_t count);
+	bool lookingAt(const char* str);
+	void skipWhiteSpace(std::string* out);
+	bool readUntil(const char* endTag, std::string* out);
+	void readName(std::string& name);
+	TagEnd readAttributes(const char* const* wanted, int numWanted, Frame& frame);
+	void decode(std::string& raw, int flags, std::string& value);
+	void openFrame(const std::string& name, Role role);
+	void closeFrame(XtrfCacheEntry& entry);
+	bool fail(const char* what);
+
+	// disable copy
+	XtrfScanner(const XtrfScanner&);
+	XtrfScanner& operator=(const XtrfScanner&);
+};
+
+XtrfScanner::XtrfScanner(int fd) :
+	m_fd(fd), m_buf(ChunkSize), m_pos(0), m_end(0), m_offset(0), m_eof(false), m_readError(false), m_readErrno(0),
+	m_hash(14695981039346656037ULL), m_error(), m_stack(), m_depth(0), m_attrNames(), m_scratch() {}
+
+size_t XtrfScanner::read(char* buf, size_t size) {
+	// Hashes what it reads, 0 at the end of the file or on a read error
+	ssize_t got;
+	while((got = ::read(m_fd, buf, size)) < 0 && errno == EINTR) {}
+	if(got < 0) {
+		m_readError = true;
+		m_readErrno = errno;
+		return 0;
+	}
+	for(ssize_t i = 0; i < got; ++i) {
+		m_hash ^= static_cast< unsigned char >(buf[i]);
+		m_hash *= 1099511628211ULL;
+	}
+	return static_cast< size_t >(got);
+}
+
+bool XtrfScanner::fill(size_t count) {
+	while(m_end - m_pos < count && !m_eof) {
+		// Keep the unread bytes, read behind them
+		if(m_pos != 0) {
+			memmove(&m_buf[0], &m_buf[m_pos], m_end - m_pos);
+			m_offset += m_pos;
+			m_end -= m_pos;
+			m_pos = 0;
+		}
+		const size_t got = read(&m_buf[m_end], m_buf.size() - m_end);
+		// tinyxml2 sees the document as a C string: a NUL ends it
+		const char* nul = static_cast< const char* >(memchr(&m_buf[m_end], 0, got));
+		if(NULL != nul) {
+			m_end = nul - &m_buf[0];
+			m_eof = true;
+		}
+		else {
+			m_end += got;
+		}
+		if(got == 0) m_eof = true;
+	}
+	return m_end - m_pos >= count;
+}
+
+bool XtrfScanner::lookingAt(const char* str) {
+	const size_t length = strlen(str);
+	return fill(length) && memcmp(&m_buf[m_pos], str, length) == 0;
+}
+
+void XtrfScanner::skipWhiteSpace(std::string* out) {
+	while(fill(1)) {
+		const size_t start = m_pos;
+		while(m_pos < m_end && tinyxml2::XMLUtil::IsWhiteSpace(m_buf[m_pos])) ++m_pos;
+		if(NULL != out) out->append(&m_buf[start], m_pos - start);
+		if(m_pos < m_end) return;
+	}
+}
+
+bool XtrfScanner::readUntil(const char* endTag, std::string* out) {
+	// Consumes up to and including endTag, out gets what was before it
+	while(fill(1)) {
+		const char* start = &m_buf[m_pos];
+		const char* hit = static_cast< const char* >(memchr(start, endTag[0], m_end - m_pos));
+		const size_t count = (NULL != hit) ? static_cast< size_t >(hit - start) : m_end - m_pos;
+		if(NULL != out) out->append(start, count);
+		m_pos += count;
+		if(NULL == hit) continue;
+		if(lookingAt(endTag)) {
+			m_pos += strlen(endTag);
+			return true;
+		}
+		if(NULL != out) out->push_back(m_buf[m_pos]);
+		++m_pos;
+	}
+	return false;
+}
+
+void XtrfScanner::readName(std::string& name) {
+	name.clear();
+	if(!fill(1) || !tinyxml2::XMLUtil::IsNameStartChar(m_buf[m_pos])) return;
+	while(fill(1)) {
+		const size_t start = m_pos;
+		while(m_pos < m_end && tinyxml2::XMLUtil::IsNameChar(m_buf[m_pos])) ++m_pos;
+		name.append(&m_buf[start], m_pos - start);
+		if(m_pos < m_end) return;
+	}
+}
+
+void XtrfScanner::decode(std::string& raw, int flags, std::string& value) {
+	// Same newline and entity rules as the DOM: let tinyxml2 do it, when there is something to do
+	if(raw.find_first_of((flags & tinyxml2::StrPair::NEEDS_ENTITY_PROCESSING) ? "&\r\n" : "\r\n") == std::string::npos) {
+		value.swap(raw);
+		return;
+	}
+	raw.push_back('\0');
+	tinyxml2::StrPair str;
+	str.Set(&raw[0], &raw[raw.size() - 1], flags);
+	value = str.GetStr();
+}
+
+XtrfScanner::TagEnd XtrfScanner::readAttributes(const char* const* wanted, int numWanted, Frame& frame) {
+	m_attrNames.clear();
+	frame.m_hasAttr[0] = frame.m_hasAttr[1] = false;
+	for(;;) {
+		skipWhiteSpace(NULL);
+		if(!fill(1)) return TAG_ERROR;
+		if(tinyxml2::XMLUtil::IsNameStartChar(m_buf[m_pos])) {
+			m_attrNames.push_back(std::string());
+			std::string& name = m_attrNames.back();
+			readName(name);
+			if(!fill(1)) return TAG_ERROR;
+			skipWhiteSpace(NULL);
+			if(!lookingAt("=")) return TAG_ERROR;
+			++m_pos;
+			skipWhiteSpace(NULL);
+			if(!lookingAt("\"") && !lookingAt("'")) return TAG_ERROR;
+			const char endTag[2] = { m_buf[m_pos], 0 };
+			++m_pos;
+			int idx = 0;
+			while(idx < numWanted && name != wanted[idx]) ++idx;
+			m_scratch.clear();
+			if(!readUntil(endTag, (idx < numWanted) ? &m_scratch : NULL)) return TAG_ERROR;
+			if(std::find(m_attrNames.begin(), m_attrNames.end() - 1, name) != m_attrNames.end() - 1) return TAG_ERROR;   // duplicate
+			if(idx < numWanted) {
+				decode(m_scratch, tinyxml2::StrPair::ATTRIBUTE_VALUE, frame.m_attr[idx]);
+				frame.m_hasAttr[idx] = true;
+			}
+		}
+		else if(lookingAt(">")) {
+			++m_pos;
+			return TAG_OPEN;
+		}
+		else if(lookingAt("/>")) {
+			m_pos += 2;
+			return TAG_CLOSED;
+		}
+		else {
+			return TAG_ERROR;
+		}
+	}
+}
+
+void XtrfScanner::openFrame(const std::string& name, Role role) {
+	if(m_depth == m_stack.size()) m_stack.push_back(Frame());
+	Frame& frame = m_stack[m_depth++];
+	frame.m_name = name;
+	frame.m_role = role;
+	frame.m_found = frame.m_hasChild = frame.m_isText = false;
+	frame.m_gdr.clear();
+}
+
+void XtrfScanner::closeFrame(XtrfCacheEntry& entry) {
+	Frame& frame = m_stack[--m_depth];
+	if(frame.m_role == FIELD) {
+		// Same checks as Xtrf::processRecord(): FIELDS and RECORD are the two frames below
+		Frame& record = m_stack[m_depth - 2];
+		if(!frame.m_hasAttr[0]) return;
+		if(strncmp("GDR", record.m_attr[0].c_str(), 3) == 0) {
+			if(!frame.m_hasAttr[1]) return;
+			record.m_gdr.push_back(GdrField(frame.m_attr[0], frame.m_attr[1], std::string()));
+			if(frame.m_isText) record.m_gdr.back().m_value.swap(frame.m_value);
+		}
+		else if(frame.m_isText) {
+			entry.m_stdFields.swap(XtrfFields::intern(record.m_attr[0], frame.m_attr[0]), frame.m_value);
+		}
+	}
+	else if(frame.m_role == RECORD && strncmp("GDR", frame.m_attr[0].c_str(), 3) == 0) {
+		entry.m_gdrData.push_back(compileGdr(frame.m_gdr));
+		// Moved into a record of the exact size, the frame keeps its capacity
+		entry.m_gdrRecords.push_back(GdrRecord(std::make_move_iterator(frame.m_gdr.begin()), std::make_move_iterator(frame.m_gdr.end())));
+	}
+}
+
+bool XtrfScanner::fail(const char* what) {
+	std::ostringstream errStream;
+	if(m_readError) errStream << "read error: " << ::strerror(m_readErrno);
+	else errStream << what << " at offset " << (m_offset + m_pos);
+	m_error = errStream.str();
+	return false;
+}
+
+unsigned long long XtrfScanner::hash() {
+	// Content hash of the whole file, also what follows the point the scan stopped at
+	char drain[ChunkSize];
+	while(!m_readError && read(drain, sizeof(drain)) != 0) {}
+	return m_hash;
+}
+
+bool XtrfScanner::scan(XtrfCacheEntry& entry) {
+	static const char* const recordAttrs[] = { "recordName" };
+	static const char* const fieldAttrs[] = { "fieldName", "dataType" };
+	bool rootSeen = false;
+	bool declAllowed = true;       // declarations only come first, at document level
+	std::string lead, name;
+
+	skipWhiteSpace(NULL);
+	if(lookingAt("\xEF\xBB\xBF")) m_pos += 3;
+	if(!fill(1)) return fail("empty document");
+	for(;;) {
+		lead.clear();
+		skipWhiteSpace(&lead);
+		if(!fill(1)) {
+			if(m_depth != 0) return fail("unclosed element");
+			return m_readError ? fail("") : true;
+		}
+		// The first child node of a field is the one that can carry its value
+		Frame* field = (m_depth != 0 && m_stack[m_depth - 1].m_role == FIELD && !m_stack[m_depth - 1].m_hasChild) ?
+			&m_stack[m_depth - 1] : NULL;
+		if(NULL != field) field->m_hasChild = true;
+		// (openFrame() may move the frames, field and parent are not used past it)
+		const bool docLevel = (m_depth == 0);
+		if(lookingAt("<?")) {
+			m_pos += 2;
+			if(!docLevel || !declAllowed) return fail("misplaced declaration");
+			if(!readUntil("?>", NULL)) return fail("unterminated declaration");
+			continue;
+		}
+		if(docLevel) declAllowed = false;
+		if(lookingAt("<!--")) {
+			m_pos += 4;
+			if(!readUntil("-->", NULL)) return fail("unterminated comment");
+		}
+		else if(lookingAt("<![CDATA[")) {
+			m_pos += 9;
+			m_scratch.clear();
+			if(!readUntil("]]>", (NULL != field) ? &m_scratch : NULL)) return fail("unterminated CDATA");
+			if(NULL != field) {
+				decode(m_scratch, tinyxml2::StrPair::NEEDS_NEWLINE_NORMALIZATION, field->m_value);
+				field->m_isText = true;
+			}
+		}
+		else if(lookingAt("<!")) {
+			m_pos += 2;
+			if(!readUntil(">", NULL)) return fail("unterminated markup");
+		}
+		else if(lookingAt("<")) {
+			++m_pos;
+			skipWhiteSpace(NULL);
+			const bool closing = lookingAt("/");
+			if(closing) ++m_pos;
+			readName(name);
+			if(name.empty()) return fail("missing element name");
+			// Pick the attributes this element needs from where it sits
+			Role role = OTHER;
+			const char* const* wanted = NULL;
+			int numWanted = 0;
+			Frame* parent = docLevel ? NULL : &m_stack[m_depth - 1];
+			if(!closing) {
+				if(NULL == parent) {
+					if(!rootSeen) { role = ROOT; rootSeen = true; }
+				}
+				else if(parent->m_role == ROOT && !parent->m_found && name == "STDF") {
+					role = STDF; parent->m_found = true;
+				}
+				else if(parent->m_role == STDF && name == "STDFrecord") {
+					role = RECORD; wanted = recordAttrs; numWanted = 1;
+				}
+				else if(parent->m_role == RECORD && !parent->m_found && name == "STDFfields") {
+					role = FIELDS; parent->m_found = true;
+				}
+				else if(parent->m_role == FIELDS && name == "STDFfield") {
+					role = FIELD; wanted = fieldAttrs; numWanted = 2;
+				}
+			}
+			openFrame(name, role);
+			const TagEnd tagEnd = readAttributes(wanted, numWanted, m_stack[m_depth - 1]);
+			if(tagEnd == TAG_ERROR) return fail("malformed element");
+			if(role == RECORD && !m_stack[m_depth - 1].m_hasAttr[0]) m_stack[m_depth - 1].m_role = OTHER;
+			if(closing && tagEnd == TAG_OPEN) {
+				// The end tag of the enclosing element. At document level tinyxml2 stops there.
+				--m_depth;
+				if(docLevel) return true;
+				if(m_stack[m_depth - 1].m_name != name) return fail("mismatched element");
+				closeFrame(entry);
+			}
+			else if(tagEnd == TAG_CLOSED) {
+				closeFrame(entry);
+			}
+		}
+		else {
+			// Text, with the whitespace before it
+			if(NULL != field) {
+				m_scratch.swap(lead);
+				if(!readUntil("<", &m_scratch)) return fail("unterminated text");
+				decode(m_scratch, tinyxml2::StrPair::TEXT_ELEMENT, field->m_value);
+				field->m_isText = true;
+			}
+			else if(!readUntil("<", NULL)) {
+				return fail("unterminated text");
+			}
+			--m_pos;
+		}
+	}
+}
+
+bool Xtrf::parseContent(const char* content, size_t size, XtrfCacheEntry& entry) {
+	// Load XTRF document, in a document kept from the previous parse so its pools and buffer are reused
+	static const size_t ReuseLimit = 16 << 20; // bytes of XML, a larger document is not kept around
+	if(m_documents.empty()) {
+		m_documents.push_back(std::unique_ptr< tinyxml2::XMLDocument >(new tinyxml2::XMLDocument()));
+		m_documents.back()->SetReuseMemory(true);
+	}
+	tinyxml2::XMLDocument& xtrfDoc = *m_documents.back();
+	tinyxml2::XMLError errCode;
+	{
+		// XMLDocument::Parse() copies mapped contents before it parses them, a fault in that copy
+		// comes back here. m_errorStr is left empty for load() to report the shrunk file.
+		XtrfFaultGuard guard(content, size);
+		if(sigsetjmp(guard.m_jump, 1) == 0) {
+			errCode = xtrfDoc.Parse(content, size);
+			m_errorStr = xtrfDoc.ErrorStr();
+		}
+		else {
+			xtrfDoc.Clear();
+			errCode = tinyxml2::XML_ERROR_FILE_READ_ERROR;
+			m_errorStr = "";
+		}
+	}
 	if(errCode != tinyxml2::XML_SUCCESS) {
+		if(size > ReuseLimit) m_documents.pop_back();
 		return false;
 	}
+	// processRecord() fills the members, collect this file's fields in the entry
+	m_stdFields.swap(entry.m_stdFields);
+	m_gdrRecords.swap(entry.m_gdrRecords);
+	m_gdrData.swap(entry.m_gdrData);
 	// Try to get the first testerRecipe.STDF.STDFrecord element
 	//tinyxml2::XMLElement* stdfRecordElt = xtrfDoc.FirstChildElement("testerRecipe");
+	const XtrfXmlNames& names(XtrfXmlNames::get());
 	tinyxml2::XMLElement* stdfRecordElt = xtrfDoc.RootElement();
-	if(stdfRecordElt) stdfRecordElt = stdfRecordElt->FirstChildElement("STDF");
-	if(stdfRecordElt) stdfRecordElt = stdfRecordElt->FirstChildElement("STDFrecord");
+	if(stdfRecordElt) stdfRecordElt = stdfRecordElt->FirstChildElement(names.m_stdf);
+	if(stdfRecordElt) stdfRecordElt = stdfRecordElt->FirstChildElement(names.m_stdfRecord);
 	// Iterate over all testerRecipe.STDF.STDFrecord elements
-	for(;NULL != stdfRecordElt; stdfRecordElt=stdfRecordElt->NextSiblingElement("STDFrecord")) {
+	for(;NULL != stdfRecordElt; stdfRecordElt=stdfRecordElt->NextSiblingElement(names.m_stdfRecord)) {
 		// Try to get the record name. If record name was not set, skip it.
-		const char* recordName = stdfRecordElt->Attribute("recordName");
+		const char* recordName = stdfRecordElt->Attribute(names.m_recordName);
 		if(NULL == recordName) continue;
 		processRecord(recordName, stdfRecordElt);
 	}
+	m_stdFields.swap(entry.m_stdFields);
+	m_gdrRecords.swap(entry.m_gdrRecords);
+	m_gdrData.swap(entry.m_gdrData);
+	// The nodes go back to the pools
+	if(size > ReuseLimit) m_documents.pop_back();
+	else xtrfDoc.Clear();
 	return true;
 }
 
-bool Xtrf::loadGnbTesterTable(const std::string& fileName, const std::string& mytesterName) {
-	// Fill defaults
-	fillDefaults();
-	// Open the file
+void Xtrf::merge(const XtrfCacheEntry& entry) {
+	// Same result as processing the records on top of the current content
+	const std::vector< int >& ids = entry.m_stdFields.ids();
+	for(std::vector< int >::const_iterator id = ids.begin(); id != ids.end(); ++id) {
+		set(*id, entry.m_stdFields.get(*id));
+	}
+	m_gdrRecords.insert(m_gdrRecords.end(), entry.m_gdrRecords.begin(), entry.m_gdrRecords.end());
+	m_gdrData.insert(m_gdrData.end(), entry.m_gdrData.begin(), entry.m_gdrData.end());
+}
+
+/**
+ * Binary sidecar: a parse result saved in the datalog cache directory
+ * /tmp/st_dlog_xbin_<euid>, named after a hash of the recipe path, used instead
+ * of the XML while the recipe keeps the stat identity it was saved with. The
+ * directory is private to the user; one that is not a directory of its own with
+ * mode 0700 is not used. Header, then the payload:
+ *   fields:   count, then (name, value) in the order they were set
+ *   GDRs:     count, then per record its fields (name, type, value) and its
+ *             compiled values (type, int, uint, real, str)
+ * Integers are native 32/64 bit, strings a 32 bit length and the bytes. The
+ * checksum covers the payload; a wrong magic, version, byte order, size or
+ * checksum makes the sidecar stale like a changed recipe does.
+ */
+struct XtrfSidecarHeader {
+	char m_magic[8];
+	uint32_t m_version;
+	uint32_t m_byteOrder;
+	uint64_t m_device;               /** stat identity of the recipe */
+	uint64_t m_inode;
+	int64_t m_size;
+	int64_t m_mtimeSec;
+	int64_t m_mtimeNsec;
+	uint64_t m_hash;                 /** XtrfCacheEntry::m_hash of the recipe */
+	uint64_t m_payloadSize;
+	uint64_t m_checksum;
+};
+
+static const char SidecarMagic[8] = { 'X', 'T', 'R', 'F', 'B', 'I', 'N', '\0' };
+static const uint32_t SidecarVersion = 1;        // bump when the layout or compileGdr() changes
+static const uint32_t SidecarByteOrder = 0x01020304;
+
+static std::string sidecarName(const std::string& file, bool create) {
+	// Empty when the cache directory is not usable
+	std::ostringstream dir;
+	dir << "/tmp/st_dlog_xbin_" << ::geteuid();
+	if(create && ::mkdir(dir.str().c_str(), 0700) != 0 && errno != EEXIST) return std::string();
+	struct stat dirStat;
+	if(::lstat(dir.str().c_str(), &dirStat) != 0 || !S_ISDIR(dirStat.st_mode)
+		|| dirStat.st_uid != ::geteuid() || (dirStat.st_mode & 0777) != 0700) {
+		return std::string();
+	}
+	// The stat identity in the header tells recipes with the same name hash apart
+	char* const resolved = ::realpath(file.c_str(), NULL);
+	const std::string path = (NULL != resolved) ? resolved : file;
+	::free(resolved);
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t at = 0; at < path.size(); ++at) {
+		hash = (hash ^ static_cast< unsigned char >(path[at])) * 1099511628211ULL;
+	}
+	std::ostringstream name;
+	name << dir.str() << "/" << std::hex << hash << ".xbin";
+	return name.str();
+}
+
+// FNV-1a over 64 bit words, then the remaining bytes
+static uint64_t sidecarChecksum(const char* data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	size_t at = 0;
+	for(; at + sizeof(uint64_t) <= size; at += sizeof(uint64_t)) {
+		uint64_t word;
+		::memcpy(&word, data + at, sizeof(word));
+		hash = (hash ^ word) * 1099511628211ULL;
+	}
+	for(; at < size; ++at) {
+		hash = (hash ^ static_cast< unsigned char >(data[at])) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+class XtrfSidecarWriter {
+public:
+	XtrfSidecarWriter() : m_data() {}
+
+	template< typename T > inline void put(T value) { m_data.append(reinterpret_cast< const char* >(&value), sizeof(value)); }
+	inline void put(const std::string& value) { put(static_cast< uint32_t >(value.size())); m_data.append(value); }
+	inline std::string& data() { return m_data; }
+
+private:
+	std::string m_data;
+};
+
+class XtrfSidecarReader {
+public:
+	XtrfSidecarReader(const char* data, size_t size) : m_at(data), m_end(data + size), m_ok(true) {}
+
+	template< typename T > inline T get() {
+		T value = T();
+		if(static_cast< size_t >(m_end - m_at) < sizeof(value)) { m_ok = false; return value; }
+		::memcpy(&value, m_at, sizeof(value));
+		m_at += sizeof(value);
+		return value;
+	}
+	inline void get(std::string& value) {
+		const uint32_t size = get< uint32_t >();
+		if(static_cast< size_t >(m_end - m_at) < size) { m_ok = false; return; }
+		value.assign(m_at, size);
+		m_at += size;
+	}
+	inline bool ok() const { return m_ok && m_at == m_end; }
+	inline bool good() const { return m_ok; }
+	inline size_t left() const { return m_end - m_at; }
+
+private:
+	const char* m_at;
+	const char* const m_end;
+	bool m_ok;
+};
+
+static bool loadSidecar(const std::string& file, const struct stat& fileStat, XtrfCacheEntry& entry) {
+	const std::string name = sidecarName(file, false);
+	if(name.empty()) return false;
+	const int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	if(fd < 0) return false;
+	struct stat sidecarStat;
+	void* map = MAP_FAILED;
+	if(::fstat(fd, &sidecarStat) == 0 && static_cast< size_t >(sidecarStat.st_size) >= sizeof(XtrfSidecarHeader)) {
+		map = ::mmap(NULL, static_cast< size_t >(sidecarStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	::close(fd);
+	if(map == MAP_FAILED) return false;
+	const size_t mapSize = static_cast< size_t >(sidecarStat.st_size);
+	::madvise(map, mapSize, MADV_SEQUENTIAL);
+	const char* const data = static_cast< const char* >(map);
+	XtrfSidecarHeader header;
+	::memcpy(&header, data, sizeof(header));
+	XtrfFileStamp stamp;
+	stamp.m_device = header.m_device;
+	stamp.m_inode = header.m_inode;
+	stamp.m_size = header.m_size;
+	stamp.m_mtimeSec = header.m_mtimeSec;
+	stamp.m_mtimeNsec = header.m_mtimeNsec;
+	const char* const payload = data + sizeof(header);
+	bool loaded = ::memcmp(header.m_magic, SidecarMagic, sizeof(SidecarMagic)) == 0
+		&& header.m_version == SidecarVersion && header.m_byteOrder == SidecarByteOrder
+		&& stamp.matches(fileStat)
+		&& header.m_payloadSize == mapSize - sizeof(header)
+		&& header.m_checksum == sidecarChecksum(payload, header.m_payloadSize);
+	if(loaded) {
+		XtrfSidecarReader reader(payload, header.m_payloadSize);
+		std::string name, value;
+		for(uint32_t count = reader.get< uint32_t >(); reader.good() && count > 0; --count) {
+			reader.get(name);
+			reader.get(value);
+			if(reader.good()) entry.m_stdFields.swap(XtrfFields::intern(name), value);
+		}
+		// Every record takes at least its two counts, that bounds a corrupt count
+		const uint64_t records = reader.get< uint64_t >();
+		loaded = reader.good() && records <= reader.left() / (2 * sizeof(uint32_t));
+		if(loaded) {
+			entry.m_gdrRecords.resize(records);
+			entry.m_gdrData.resize(records);
+		}
+		for(uint64_t record = 0; loaded && reader.good() && record < records; ++record) {
+			GdrRecord& gdr = entry.m_gdrRecords[record];
+			const uint32_t fields = reader.get< uint32_t >();
+			if(fields > reader.left() / (3 * sizeof(uint32_t))) loaded = false;
+			if(loaded) gdr.reserve(fields);
+			for(uint32_t field = 0; loaded && reader.good() && field < fields; ++field) {
+				gdr.push_back(GdrField(std::string(), std::string(), std::string()));
+				reader.get(gdr.back().m_name);
+				reader.get(gdr.back().m_type);
+				reader.get(gdr.back().m_value);
+			}
+			GdrDataList& gdrData = entry.m_gdrData[record];
+			const uint32_t values = reader.get< uint32_t >();
+			if(values > reader.left() / (3 * sizeof(uint32_t) + sizeof(double) + sizeof(int32_t))) loaded = false;
+			if(loaded) gdrData.reserve(values);
+			for(uint32_t value = 0; loaded && reader.good() && value < values; ++value) {
+				gdrData.push_back(GdrData(static_cast< GdrDataType >(reader.get< uint32_t >())));
+				gdrData.back().m_int = reader.get< int32_t >();
+				gdrData.back().m_uint = reader.get< uint32_t >();
+				gdrData.back().m_real = reader.get< double >();
+				reader.get(gdrData.back().m_str);
+			}
+		}
+		loaded = loaded && reader.ok();
+	}
+	::munmap(map, mapSize);
+	if(!loaded) {
+		entry = XtrfCacheEntry();
+		return false;
+	}
+	entry.m_stamp = stamp;
+	entry.m_hash = header.m_hash;
+	return true;
+}
+
+static void writeSidecar(const std::string& file, const XtrfCacheEntry& entry) {
+	// Best effort: written aside and renamed over, a reader sees the old sidecar or the new one
+	XtrfSidecarWriter writer;
+	writer.data().resize(sizeof(XtrfSidecarHeader));
+	const std::vector< int >& ids = entry.m_stdFields.ids();
+	writer.put(static_cast< uint32_t >(ids.size()));
+	for(std::vector< int >::const_iterator id = ids.begin(); id != ids.end(); ++id) {
+		writer.put(XtrfFields::name(*id));
+		writer.put(entry.m_stdFields.get(*id));
+	}
+	writer.put(static_cast< uint64_t >(entry.m_gdrRecords.size()));
+	for(size_t record = 0; record < entry.m_gdrRecords.size(); ++record) {
+		const GdrRecord& gdr = entry.m_gdrRecords[record];
+		writer.put(static_cast< uint32_t >(gdr.size()));
+		for(GdrRecord::const_iterator field = gdr.begin(); field != gdr.end(); ++field) {
+			writer.put(field->m_name);
+			writer.put(field->m_type);
+			writer.put(field->m_value);
+		}
+		const GdrDataList& gdrData = entry.m_gdrData[record];
+		writer.put(static_cast< uint32_t >(gdrData.size()));
+		for(GdrDataList::const_iterator value = gdrData.begin(); value != gdrData.end(); ++value) {
+			writer.put(static_cast< uint32_t >(value->m_type));
+			writer.put(static_cast< int32_t >(value->m_int));
+			writer.put(static_cast< uint32_t >(value->m_uint));
+			writer.put(value->m_real);
+			writer.put(value->m_str);
+		}
+	}
+	std::string& data = writer.data();
+	XtrfSidecarHeader header;
+	::memset(&header, 0, sizeof(header));
+	::memcpy(header.m_magic, SidecarMagic, sizeof(SidecarMagic));
+	header.m_version = SidecarVersion;
+	header.m_byteOrder = SidecarByteOrder;
+	header.m_device = entry.m_stamp.m_device;
+	header.m_inode = entry.m_stamp.m_inode;
+	header.m_size = entry.m_stamp.m_size;
+	header.m_mtimeSec = entry.m_stamp.m_mtimeSec;
+	header.m_mtimeNsec = entry.m_stamp.m_mtimeNsec;
+	header.m_hash = entry.m_hash;
+	header.m_payloadSize = data.size() - sizeof(header);
+	header.m_checksum = sidecarChecksum(data.data() + sizeof(header), header.m_payloadSize);
+	::memcpy(&data[0], &header, sizeof(header));
+
+	const std::string name = sidecarName(file, true);
+	if(name.empty()) return;
+	std::ostringstream tmpName;
+	tmpName << name << ".tmp" << ::getpid() << "." << std::this_thread::get_id();
+	const int fd = ::open(tmpName.str().c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+	if(fd < 0) return;
+	const char* at = data.data();
+	size_t left = data.size();
+	while(left > 0) {
+		const ssize_t done = ::write(fd, at, left);
+		if(done < 0 && errno == EINTR) continue;
+		if(done <= 0) break;
+		at += done;
+		left -= static_cast< size_t >(done);
+	}
+	if(::close(fd) != 0 || left > 0 || ::rename(tmpName.str().c_str(), name.c_str()) != 0) {
+		::unlink(tmpName.str().c_str());
+	}
+}
+
+XtrfCacheEntry* Xtrf::load(const std::string& file) {
+	// The result stays in the cache, NULL with m_errorStr set on failure
+	// The file is unchanged since it was last parsed: reuse the result
+	struct stat fileStat;
+	std::map< std::string, XtrfCacheEntry >::iterator cached = m_parseCache.find(file);
+	const bool statOk = (::stat(file.c_str(), &fileStat) == 0);
+	if(cached != m_parseCache.end() && statOk && cached->second.m_stamp.matches(fileStat)) {
+		++m_cacheHits;
+		m_errorStr = "";
+		return &cached->second;
+	}
+	// Or since its sidecar was saved
+	XtrfCacheEntry saved;
+	if(m_useSidecar && statOk && loadSidecar(file, fileStat, saved)) {
+		++m_sidecarHits;
+		m_errorStr = "";
+		XtrfCacheEntry& entry = m_parseCache[file];
+		std::swap(entry, saved);
+		return &entry;
+	}
+	XtrfCacheEntry parsed;
+	bool parsedOk;
+	if(m_parseMode == PARSE_STREAM) {
+		// One pass in chunks, scanned and hashed as they are read. There is no content
+		// check before the scan: a touched file is scanned again.
+		const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0 || ::fstat(fd, &fileStat) != 0) {
+			m_parseCache.erase(file);
+			m_errorStr = "Failed to open " + file + ". Error details:" + ::strerror(errno);
+			if(fd >= 0) ::close(fd);
+			return NULL;
+		}
+		++m_cacheMisses;
+		XtrfScanner scanner(fd);
+		parsedOk = scanner.scan(parsed);
+		if(parsedOk) parsed.m_hash = scanner.hash();
+		::close(fd);
+		m_errorStr = parsedOk ? std::string() : "Failed to parse " + file + ": " + scanner.error();
+	}
+	else {
+		// Map or read it and check the content: touched or copied over, but the same content reuses the result too
+		XtrfContents contents;
+		if(!contents.open(file, fileStat)) {
+			m_parseCache.erase(file);
+			m_errorStr = "Failed to open " + file + ". Error details:" + ::strerror(errno);
+			return NULL;
+		}
+		if(!contents.hash(parsed.m_hash)) {
+			m_parseCache.erase(file);
+			m_errorStr = "Failed to read " + file + ": it shrank while it was read";
+			return NULL;
+		}
+		if(cached != m_parseCache.end() && cached->second.m_hash == parsed.m_hash) {
+			++m_cacheHits;
+			cached->second.m_stamp.set(fileStat);
+			m_errorStr = "";
+			return &cached->second;
+		}
+		++m_cacheMisses;
+		parsedOk = parseContent(contents.data(), contents.size(), parsed);
+		if(!parsedOk && m_errorStr.empty()) m_errorStr = "Failed to read " + file + ": it shrank while it was read";
+	}
+	if(!parsedOk) {
+		m_parseCache.erase(file);
+		return NULL;
+	}
+	parsed.m_stamp.set(fileStat);
+	// Only a parse saves a sidecar, a cache hit has nothing new to save
+	if(m_useSidecar) writeSidecar(file, parsed);
+	XtrfCacheEntry& entry = m_parseCache[file];
+	std::swap(entry, parsed);
+	return &entry;
+}
+
+bool Xtrf::parse(const std::string& file) {
+	const XtrfCacheEntry* entry = load(file);
+	if(NULL == entry) return false;
+	merge(*entry);
+	return true;
+}
+
+bool Xtrf::parse(const std::vector< std::string >& files, unsigned threads) {
+	// Each distinct file is loaded by its own Xtrf, given this one's cached result to
+	// check against. Workers pick files in turn; the results come back to this cache
+	// and are merged in list order once all are done, as if parsed one after the other.
+	std::vector< std::string > jobFiles;
+	std::vector< size_t > jobOf(files.size());
+	std::map< std::string, size_t > jobByFile;
+	for(size_t i = 0; i < files.size(); ++i) {
+		std::map< std::string, size_t >::const_iterator known = jobByFile.find(files[i]);
+		if(known == jobByFile.end()) {
+			known = jobByFile.insert(std::make_pair(files[i], jobFiles.size())).first;
+			jobFiles.push_back(files[i]);
+		}
+		jobOf[i] = known->second;
+	}
+	std::vector< std::unique_ptr< Xtrf > > parts(jobFiles.size());
+	std::vector< XtrfCacheEntry* > results(jobFiles.size(), static_cast< XtrfCacheEntry* >(NULL));
+	for(size_t job = 0; job < jobFiles.size(); ++job) {
+		parts[job].reset(new Xtrf());
+		parts[job]->m_parseMode = m_parseMode;
+		parts[job]->m_useSidecar = m_useSidecar;
+		// Lend the kept documents, they come back with the results
+		if(!m_documents.empty()) {
+			parts[job]->m_documents.push_back(std::move(m_documents.back()));
+			m_documents.pop_back();
+		}
+		std::map< std::string, XtrfCacheEntry >::iterator cached = m_parseCache.find(jobFiles[job]);
+		if(cached != m_parseCache.end()) std::swap(parts[job]->m_parseCache[jobFiles[job]], cached->second);
+	}
+	std::atomic< size_t > nextJob(0);
+	const auto work = [&]() {
+		for(size_t job = nextJob++; job < jobFiles.size(); job = nextJob++) {
+			try {
+				results[job] = parts[job]->load(jobFiles[job]);
+			}
+			catch(const std::exception& e) {
+				parts[job]->m_errorStr = "Failed to parse " + jobFiles[job] + ": " + e.what();
+			}
+		}
+	};
+	if(0 == threads) threads = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+	threads = static_cast< unsigned >(std::min< size_t >(threads, jobFiles.size()));
+	std::vector< std::thread > pool;
+	pool.reserve(threads);
+	for(unsigned t = 1; t < threads; ++t) {
+		try {
+			pool.push_back(std::thread(work));
+		}
+		catch(const std::system_error&) {
+			break; // the ones started and this thread do the rest
+		}
+	}
+	work();
+	for(std::vector< std::thread >::iterator t = pool.begin(); t != pool.end(); ++t) t->join();
+
 	bool success = true;
+	m_errorStr = "";
+	for(size_t job = 0; job < jobFiles.size(); ++job) {
+		m_cacheHits += parts[job]->m_cacheHits;
+		m_cacheMisses += parts[job]->m_cacheMisses;
+		m_sidecarHits += parts[job]->m_sidecarHits;
+		for(size_t document = 0; document < parts[job]->m_documents.size(); ++document) {
+			m_documents.push_back(std::move(parts[job]->m_documents[document]));
+		}
+		if(NULL != results[job]) {
+			std::swap(m_parseCache[jobFiles[job]], *results[job]);
+		}
+		else {
+			m_parseCache.erase(jobFiles[job]);
+			if(success) m_errorStr = parts[job]->m_errorStr;
+			success = false;
+		}
+	}
+	for(size_t i = 0; i < files.size(); ++i) {
+		if(NULL != results[jobOf[i]]) merge(m_parseCache[files[i]]);
+	}
+	return success;
+}
+
+bool Xtrf::reload(const std::string& file) {
+	// Forget the cached result, parse the file again even if it looks unchanged
+	m_parseCache.erase(file);
+	return parse(file);
+}
+
+std::vector< std::string > Xtrf::expandSources(const std::string& sources, std::vector< std::string >* unmatched) {
+	// Entries separated by blanks, commas or semicolons: a file, a glob pattern
+	// or a directory (its *.xtrf files). Matches are sorted, each file listed once.
+	// An entry that names no file is not an error here, the caller reports it.
+	std::vector< std::string > files;
+	std::set< std::string > listed;
+	std::string::size_type start = 0;
+	while(start < sources.size()) {
+		const std::string::size_type end = std::min(sources.find_first_of(" \t\n,;", start), sources.size());
+		std::string pattern(sources, start, end - start);
+		start = end + 1;
+		if(pattern.empty()) continue;
+		struct stat fileStat;
+		if(::stat(pattern.c_str(), &fileStat) == 0 && S_ISDIR(fileStat.st_mode)) pattern += "/*.xtrf";
+		glob_t matches;
+		if(::glob(pattern.c_str(), 0, NULL, &matches) == 0) {
+			for(size_t i = 0; i < matches.gl_pathc; ++i) {
+				if(listed.insert(matches.gl_pathv[i]).second) files.push_back(matches.gl_pathv[i]);
+			}
+		}
+		else if(NULL != unmatched) unmatched->push_back(pattern);
+		::globfree(&matches);
+	}
+	return files;
+}
+
+void Xtrf::publish() {
+	std::shared_ptr< XtrfSnapshot > snapshot(std::make_shared< XtrfSnapshot >());
+	snapshot->m_stdFields = m_stdFields;
+	snapshot->m_gdrRecords = m_gdrRecords;
+	snapshot->m_gdrData = m_gdrData;
+	publish(snapshot);
+}
+
+void Xtrf::publish(const std::shared_ptr< const XtrfSnapshot >& snapshot) {
+	// Readers holding the previous snapshot keep it until they let it go, the
+	// last one of them (or this) frees it outside the lock
+	std::shared_ptr< const XtrfSnapshot > previous(snapshot ? snapshot : std::make_shared< const XtrfSnapshot >());
+	std::lock_guard< std::mutex > lock(m_publishMutex);
+	m_published.swap(previous);
+}
+
+std::shared_ptr< const XtrfSnapshot > Xtrf::snapshot() const {
+	std::lock_guard< std::mutex > lock(m_publishMutex);
+	return m_published;
+}
+
+std::shared_ptr< XtrfSnapshot > Xtrf::takeSnapshot() {
+	// The content moves into the snapshot, this is left empty
+	std::shared_ptr< XtrfSnapshot > snapshot(std::make_shared< XtrfSnapshot >());
+	snapshot->m_stdFields.swap(m_stdFields);
+	snapshot->m_gdrRecords.swap(m_gdrRecords);
+	snapshot->m_gdrData.swap(m_gdrData);
+	return snapshot;
+}
+
+XtrfReloader::XtrfReloader(Xtrf& target, const std::vector< std::string >& files, Xtrf::ParseMode mode) :
+	m_target(target), m_files(files), m_worker(), m_stamps(files.size()), m_error(), m_mutex(), m_reloads(0),
+	m_inotifyFd(-1), m_stopPipe(), m_thread() {
+	m_stopPipe[0] = m_stopPipe[1] = -1;
+	m_worker.setParseMode(mode);
+	m_worker.setSidecar(target.sidecar());
+}
+
+XtrfReloader::~XtrfReloader() {
+	stop();
+}
+
+bool XtrfReloader::start() {
+	stop();
+	{
+		std::lock_guard< std::mutex > lock(m_mutex);
+		reload();
+	}
+	// Watch the directories: a file renamed over a recipe is a change too
+	std::set< std::string > dirs;
+	for(std::vector< std::string >::const_iterator file = m_files.begin(); file != m_files.end(); ++file) {
+		const std::string::size_type slash = file->rfind('/');
+		dirs.insert((slash == std::string::npos) ? std::string(".") : (slash == 0) ? std::string("/") : file->substr(0, slash));
+	}
+	std::string error;
+	m_inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(m_inotifyFd < 0 || ::pipe2(m_stopPipe, O_CLOEXEC) != 0) {
+		error = std::string("Failed to set up the recipe watch. Error details:") + ::strerror(errno);
+	}
+	for(std::set< std::string >::const_iterator dir = dirs.begin(); error.empty() && dir != dirs.end(); ++dir) {
+		if(::inotify_add_watch(m_inotifyFd, dir->c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+			error = "Failed to watch " + *dir + ". Error details:" + ::strerror(errno);
+		}
+	}
+	if(error.empty()) {
+		try {
+			m_thread = std::thread(&XtrfReloader::run, this);
+		}
+		catch(const std::system_error& e) {
+			error = std::string("Failed to start the recipe watch: ") + e.what();
+		}
+	}
+	if(error.empty()) return true;
+	stop();
+	std::lock_guard< std::mutex > lock(m_mutex);
+	m_error = error;
+	return false;
+}
+
+void XtrfReloader::stop() {
+	if(m_thread.joinable()) {
+		const char wake = 0;
+		if(::write(m_stopPipe[1], &wake, 1) < 0) {}
+		m_thread.join();
+	}
+	if(m_inotifyFd >= 0) ::close(m_inotifyFd);
+	if(m_stopPipe[0] >= 0) ::close(m_stopPipe[0]);
+	if(m_stopPipe[1] >= 0) ::close(m_stopPipe[1]);
+	m_inotifyFd = m_stopPipe[0] = m_stopPipe[1] = -1;
+}
+
+bool XtrfReloader::sync() {
+	std::lock_guard< std::mutex > lock(m_mutex);
+	return changed() ? reload() : m_error.empty();
+}
+
+std::string XtrfReloader::error() {
+	std::lock_guard< std::mutex > lock(m_mutex);
+	return m_error;
+}
+
+bool XtrfReloader::changed() {
+	// m_mutex is held
+	for(size_t i = 0; i < m_files.size(); ++i) {
+		struct stat fileStat;
+		if(::stat(m_files[i].c_str(), &fileStat) != 0) {
+			if(m_stamps[i].m_size != -1) return true;
+		}
+		else if(!m_stamps[i].matches(fileStat)) return true;
+	}
+	return false;
+}
+
+bool XtrfReloader::reload() {
+	// m_mutex is held. Stamps first, a file changing during the parse is seen by the next check.
+	for(size_t i = 0; i < m_files.size(); ++i) {
+		struct stat fileStat;
+		if(::stat(m_files[i].c_str(), &fileStat) == 0) m_stamps[i].set(fileStat);
+		else m_stamps[i] = XtrfFileStamp();
+	}
+	m_worker.clear();
+	const bool success = m_worker.parse(m_files);
+	m_error = success ? std::string() : m_worker.getError();
+	m_target.publish(m_worker.takeSnapshot());
+	++m_reloads;
+	return success;
+}
+
+void XtrfReloader::run() {
+	// Reload once the files are quiet for SettleMs, a writer often closes or renames more than once
+	static const int SettleMs = 50;
+	std::set< std::string > names;
+	for(std::vector< std::string >::const_iterator file = m_files.begin(); file != m_files.end(); ++file) {
+		names.insert(file->substr(file->rfind('/') + 1));
+	}
+	std::vector< char > events(64 * 1024);
+	struct pollfd fds[2];
+	fds[0].fd = m_inotifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = m_stopPipe[0];
+	fds[1].events = POLLIN;
+	bool pending = false;
+	for(;;) {
+		fds[0].revents = fds[1].revents = 0;
+		const int ready = ::poll(fds, 2, pending ? SettleMs : -1);
+		if(ready < 0 && errno == EINTR) continue;
+		if(ready < 0 || fds[1].revents != 0) return;
+		if(ready == 0) {
+			pending = false;
+			std::lock_guard< std::mutex > lock(m_mutex);
+			if(changed()) reload();
+			continue;
+		}
+		ssize_t got;
+		while((got = ::read(m_inotifyFd, &events[0], events.size())) > 0) {
+			for(ssize_t at = 0; at < got; ) {
+				const struct inotify_event* event = reinterpret_cast< const struct inotify_event* >(&events[at]);
+				if((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && names.count(event->name) > 0)) pending = true;
+				at += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+}
+
+/**
+ * Shared memory layout: XtrfChannelHeader, then the payload
+ *   record count (64 bit), then per record its value count and per value
+ *   the GdrDataType and the value: int32 (I*n), uint32 (U*n), double (R*n)
+ *   or a 32 bit length and the bytes (C*n)
+ * m_sequence is odd while the producer writes; a reader copies the payload
+ * and keeps it only if the sequence was even and unchanged around the copy.
+ * The segment never shrinks, a reader mapping the old size stays valid and
+ * maps it again when the payload has grown past it.
+ */
+struct XtrfChannelHeader {
+	char m_magic[8];
+	uint32_t m_version;
+	uint32_t m_byteOrder;
+	std::atomic< uint64_t > m_sequence;
+	uint64_t m_payloadSize;
+	uint64_t m_checksum;
+};
+
+static const char ChannelMagic[8] = { 'X', 'T', 'R', 'F', 'S', 'H', 'M', '\0' };
+static const uint32_t ChannelVersion = 1;
+
+std::string XtrfGdrChannel::defaultName() {
+	std::ostringstream name;
+	name << "/st_dlog_gdr_" << ::geteuid();
+	return name.str();
+}
+
+std::string XtrfGdrChannel::path() const {
+	// What shm_open uses on Linux, without needing librt
+	return "/dev/shm" + ((!m_name.empty() && m_name[0] == '/') ? m_name : "/" + m_name);
+}
+
+bool XtrfGdrChannel::read(std::vector< GdrDataList >& gdrData) {
+	static const int Attempts = 1000;
+	m_error = "";
+	const int fd = ::open(path().c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		if(errno != ENOENT) m_error = "Failed to open GDR channel " + m_name + ". Error details:" + ::strerror(errno);
+		return false;
+	}
+	struct stat segmentStat;
+	void* map = MAP_FAILED;
+	size_t mapSize = 0;
+	if(::fstat(fd, &segmentStat) == 0 && static_cast< size_t >(segmentStat.st_size) >= sizeof(XtrfChannelHeader)) {
+		mapSize = static_cast< size_t >(segmentStat.st_size);
+		map = ::mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	if(map == MAP_FAILED) {
+		::close(fd);
+		m_error = "GDR channel " + m_name + " is not ready";
+		return false;
+	}
+	const XtrfChannelHeader* header = static_cast< const XtrfChannelHeader* >(map);
+	std::string copy;
+	bool consistent = false;
+	if(::memcmp(header->m_magic, ChannelMagic, sizeof(ChannelMagic)) != 0
+			|| header->m_version != ChannelVersion || header->m_byteOrder != SidecarByteOrder) {
+		m_error = "GDR channel " + m_name + " has an unknown format";
+	}
+	else {
+		for(int attempt = 0; !consistent && m_error.empty() && attempt < Attempts; ++attempt) {
+			const uint64_t before = header->m_sequence.load(std::memory_order_acquire);
+			if(before & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			const uint64_t payloadSize = header->m_payloadSize;
+			const uint64_t checksum = header->m_checksum;
+			if(payloadSize > mapSize - sizeof(XtrfChannelHeader)) {
+				// Grown by a writer since it was mapped: map the size it has now
+				if(header->m_sequence.load(std::memory_order_acquire) != before) continue;
+				if(::fstat(fd, &segmentStat) != 0 || static_cast< size_t >(segmentStat.st_size) <= mapSize) {
+					m_error = "GDR channel " + m_name + " is corrupt";
+					break;
+				}
+				::munmap(map, mapSize);
+				mapSize = static_cast< size_t >(segmentStat.st_size);
+				map = ::mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+				if(map == MAP_FAILED) {
+					::close(fd);
+					m_error = "Failed to map GDR channel " + m_name + ". Error details:" + ::strerror(errno);
+					return false;
+				}
+				header = static_cast< const XtrfChannelHeader* >(map);
+				continue;
+			}
+			copy.assign(static_cast< const char* >(map) + sizeof(XtrfChannelHeader), payloadSize);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(header->m_sequence.load(std::memory_order_relaxed) != before) continue;
+			consistent = true;
+			if(sidecarChecksum(copy.data(), copy.size()) != checksum) {
+				m_error = "GDR channel " + m_name + " is corrupt";
+			}
+		}
+		if(!consistent && m_error.empty()) m_error = "GDR channel " + m_name + " stayed busy";
+	}
+	::munmap(map, mapSize);
+	::close(fd);
+	if(!m_error.empty()) return false;
+
+	std::vector< GdrDataList > records;
+	XtrfSidecarReader reader(copy.data(), copy.size());
+	const uint64_t count = reader.get< uint64_t >();
+	bool valid = reader.good() && count <= reader.left() / sizeof(uint32_t);
+	if(valid) records.resize(count);
+	for(uint64_t record = 0; valid && record < count; ++record) {
+		const uint32_t values = reader.get< uint32_t >();
+		valid = reader.good() && values <= reader.left() / (2 * sizeof(uint32_t));
+		if(valid) records[record].reserve(values);
+		for(uint32_t value = 0; valid && value < values; ++value) {
+			const uint32_t type = reader.get< uint32_t >();
+			records[record].push_back(GdrData(static_cast< GdrDataType >(type)));
+			GdrData& data = records[record].back();
+			switch(type) {
+				case GDR_CN: reader.get(data.m_str); break;
+				case GDR_I1: case GDR_I2: case GDR_I4: data.m_int = reader.get< int32_t >(); break;
+				case GDR_U1: case GDR_U2: case GDR_U4: data.m_uint = reader.get< uint32_t >(); break;
+				case GDR_R4: case GDR_R8: data.m_real = reader.get< double >(); break;
+				default: valid = false; break;
+			}
+			valid = valid && reader.good();
+		}
+	}
+	if(!valid || !reader.ok()) {
+		m_error = "GDR channel " + m_name + " is corrupt";
+		return false;
+	}
+	gdrData.swap(records);
+	return true;
+}
+
+bool XtrfGdrChannel::write(const std::vector< GdrDataList >& gdrData) {
+	m_error = "";
+	XtrfSidecarWriter writer;
+	writer.put(static_cast< uint64_t >(gdrData.size()));
+	for(std::vector< GdrDataList >::const_iterator record = gdrData.begin(); record != gdrData.end(); ++record) {
+		writer.put(static_cast< uint32_t >(record->size()));
+		for(GdrDataList::const_iterator value = record->begin(); value != record->end(); ++value) {
+			writer.put(static_cast< uint32_t >(value->m_type));
+			switch(value->m_type) {
+				case GDR_CN: writer.put(value->m_str); break;
+				case GDR_I1: case GDR_I2: case GDR_I4: writer.put(static_cast< int32_t >(value->m_int)); break;
+				case GDR_U1: case GDR_U2: case GDR_U4: writer.put(static_cast< uint32_t >(value->m_uint)); break;
+				case GDR_R4: case GDR_R8: writer.put(value->m_real); break;
+			}
+		}
+	}
+	const std::string& payload = writer.data();
+	const size_t needed = sizeof(XtrfChannelHeader) + payload.size();
+	const int fd = ::open(path().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	struct stat segmentStat;
+	if(fd < 0 || ::fstat(fd, &segmentStat) != 0
+			|| (static_cast< size_t >(segmentStat.st_size) < needed && ::ftruncate(fd, needed) != 0)) {
+		m_error = "Failed to set up GDR channel " + m_name + ". Error details:" + ::strerror(errno);
+		if(fd >= 0) ::close(fd);
+		return false;
+	}
+	const size_t mapSize = std::max(needed, static_cast< size_t >(segmentStat.st_size));
+	void* map = ::mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(map == MAP_FAILED) {
+		m_error = "Failed to map GDR channel " + m_name + ". Error details:" + ::strerror(errno);
+		return false;
+	}
+	XtrfChannelHeader* header = static_cast< XtrfChannelHeader* >(map);
+	if(::memcmp(header->m_magic, ChannelMagic, sizeof(ChannelMagic)) != 0 || header->m_version != ChannelVersion) {
+		// New segment (zero filled) or an older layout: no reader accepts it until the magic is in
+		::memset(header->m_magic, 0, sizeof(header->m_magic));
+		header->m_version = ChannelVersion;
+		header->m_byteOrder = SidecarByteOrder;
+		header->m_sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	uint64_t sequence = header->m_sequence.load(std::memory_order_relaxed);
+	sequence += (sequence & 1); // a writer died half way
+	header->m_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	::memcpy(static_cast< char* >(map) + sizeof(XtrfChannelHeader), payload.data(), payload.size());
+	header->m_payloadSize = payload.size();
+	header->m_checksum = sidecarChecksum(payload.data(), payload.size());
+	::memcpy(header->m_magic, ChannelMagic, sizeof(ChannelMagic));
+	header->m_sequence.store(sequence + 2, std::memory_order_release);
+	::munmap(map, mapSize);
+	return true;
+}
+
+bool XtrfGdrChannel::writeFile(const std::string& xtrfFile) {
+	Xtrf xtrf;
+	if(!xtrf.parse(xtrfFile)) {
+		m_error = xtrf.getError();
+		return false;
+	}
+	return write(xtrf.gdrData());
+}
+
+bool XtrfGdrChannel::remove() {
+	m_error = "";
+	if(::unlink(path().c_str()) != 0 && errno != ENOENT) {
+		m_error = "Failed to remove GDR channel " + m_name + ". Error details:" + ::strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+// Next whitespace separated word of [p, end), empty at the end of the line
+static void nextWord(const char*& p, const char* end, std::string& word) {
+	while(p != end && ::isspace(static_cast< unsigned char >(*p))) ++p;
+	const char* start = p;
+	while(p != end && !::isspace(static_cast< unsigned char >(*p))) ++p;
+	word.assign(start, p);
+}
+
+bool Xtrf::loadTesterTable(const std::string& fileName) {
+	// Read the table again only when the file changed
+	struct stat fileStat;
+	if(::stat(fileName.c_str(), &fileStat) != 0) {
+		m_testerTableFile.clear();
+		m_testerTable.clear();
+		m_errorStr = "Failed to open "+fileName;
+		return false;
+	}
+	if(fileName == m_testerTableFile && m_testerTableStamp.matches(fileStat)) return true;
 	std::ifstream testerFile;
 	testerFile.open(fileName.c_str(), std::ios_base::in);
 	if(!testerFile.is_open()) {
+		m_testerTableFile.clear();
+		m_testerTable.clear();
 		m_errorStr = "Failed to open "+fileName;
 		return false;
 	}
+	const std::string content((std::istreambuf_iterator< char >(testerFile)), std::istreambuf_iterator< char >());
+	testerFile.close();
+	// One tester per line: name serial model handler
+	std::unordered_map< std::string, XtrfTester > table;
+	const char* line = content.data();
+	const char* const end = line + content.size();
+	while(line != end) {
+		const char* lineEnd = static_cast< const char* >(::memchr(line, '\n', end - line));
+		if(NULL == lineEnd) lineEnd = end;
+		XtrfTester tester;
+		nextWord(line, lineEnd, tester.m_name);
+		if(!tester.m_name.empty()) {
+			nextWord(line, lineEnd, tester.m_serialNum);
+			nextWord(line, lineEnd, tester.m_model);
+			nextWord(line, lineEnd, tester.m_handlerType);
+			table.insert(std::make_pair(tester.m_name, tester)); // keeps the first line of a name
+		}
+		line = (lineEnd == end) ? end : lineEnd + 1;
+	}
+	m_testerTable.swap(table);
+	m_testerTableFile = fileName;
+	m_testerTableStamp.set(fileStat);
+	return true;
+}
+
+bool Xtrf::loadGnbTesterTable(const std::string& fileName, const std::string& mytesterName) {
+	// Fill defaults
+	fillDefaults();
+	if(!loadTesterTable(fileName)) return false;
 	// Get hostname, need uppercase
 	std::string hostName(mytesterName);
 	if(hostName.find("-t") != std::string::npos) {
 		hostName = hostName.substr(0, hostName.find("-t"));
 	}
 	std::transform(hostName.begin(), hostName.end(), hostName.begin(), ::toupper);
-	// Look for the testers in the file
-	while(!testerFile.eof()) {
-		std::string readLine, testerName, serialNum, testerModel, handlerTyp;
-		std::getline(testerFile, readLine);
-		std::stringstream rwStream;
-		rwStream << readLine;
-		rwStream >> testerName >> serialNum >> testerModel >> handlerTyp;
-		if(testerName == hostName) {
-			set("MIR.NODE_NAM", testerName);
-			set("MIR.SERL_NUM", serialNum);
-			set("MIR.TSTR_TYP", testerModel);
-			set("SDR.HAND_TYP", handlerTyp);
-			success = true;
-			break;
-		}
-	}
-	testerFile.close();
-	if(!success) {
+	// Look for the tester in the table
+	std::unordered_map< std::string, XtrfTester >::const_iterator tester = m_testerTable.find(hostName);
+	if(tester == m_testerTable.end()) {
 		m_errorStr = "Failed to find this tester data in "+fileName;
+		return false;
 	}
-	return success;
+	set(XTRF_MIR_NODE_NAM, tester->second.m_name);
+	set(XTRF_MIR_SERL_NUM, tester->second.m_serialNum);
+	set(XTRF_MIR_TSTR_TYP, tester->second.m_model);
+	set(XTRF_SDR_HAND_TYP, tester->second.m_handlerType);
+	return true;
+}
+
+/**
+ * Tester type from the hardware configuration of $LTXHOME/testers/$LTX_TESTER,
+ * kept until the environment or the utl_iu_data file changes. Shared by all
+ * Xtrf instances.
+ */
+class XtrfTesterProbe {
+public:
+	XtrfTesterProbe();
+
+	std::string testerType(const char* ltxHome, const char* ltxTester);
+
+	static XtrfTesterProbe& instance();
+
+private:
+	std::string m_ltxHome;        /** environment the result was probed for */
+	std::string m_ltxTester;
+	std::string m_path;
+	bool m_probed;
+	bool m_found;                 /** utl_iu_data existed */
+	XtrfFileStamp m_stamp;
+	std::string m_testerType;
+	std::mutex m_mutex;
+
+	static std::string scan(const std::string& content);
+};
+
+XtrfTesterProbe::XtrfTesterProbe() :
+	m_ltxHome(), m_ltxTester(), m_path(), m_probed(false), m_found(false), m_stamp(), m_testerType(), m_mutex() {}
+
+XtrfTesterProbe& XtrfTesterProbe::instance() {
+	static XtrfTesterProbe l_instance;
+	return l_instance;
+}
+
+std::string XtrfTesterProbe::testerType(const char* ltxHome, const char* ltxTester) {
+	if(NULL == ltxHome || NULL == ltxTester) return "UNKNOWN";
+	std::lock_guard< std::mutex > lock(m_mutex);
+	if(!m_probed || m_ltxHome != ltxHome || m_ltxTester != ltxTester) {
+		m_ltxHome = ltxHome;
+		m_ltxTester = ltxTester;
+		m_path = m_ltxHome + "/testers/" + m_ltxTester + "/user_data/utl_iu_data";
+		m_probed = false;
+	}
+	struct stat fileStat;
+	const bool found = (::stat(m_path.c_str(), &fileStat) == 0);
+	if(m_probed && found == m_found && (!found || m_stamp.matches(fileStat))) return m_testerType;
+	std::string content;
+	std::ifstream utlIuData;
+	if(found) utlIuData.open(m_path.c_str(), std::ios_base::in);
+	if(utlIuData.is_open()) {
+		content.assign(std::istreambuf_iterator< char >(utlIuData), std::istreambuf_iterator< char >());
+		utlIuData.close();
+	}
+	m_testerType = scan(content);
+	m_found = found;
+	if(found) m_stamp.set(fileStat);
+	m_probed = true;
+	return m_testerType;
+}
+
+std::string XtrfTesterProbe::scan(const std::string& content) {
+	// Each line counts for the first of THCTL, EX_BACKPLANE, DMD_DIBU, VBP it contains.
+	// All four start with LTXC_, so one pass looks for that and tells them apart by the rest.
+	enum { THCTL, EX_BP, D10_DIBU, DXV_VBP, NONE };
+	static const char prefix[] = "LTXC_";
+	static const size_t prefixSize = sizeof(prefix) - 1;
+	static const char* const suffixes[NONE] = { "PHX_THCTL", "EX_BACKPLANE", "DMD_DIBU", "PHX_VBP" };
+	int counts[NONE] = { 0, 0, 0, 0 };
+	const char* line = content.data();
+	const char* const end = line + content.size();
+	while(line != end) {
+		const char* lineEnd = static_cast< const char* >(::memchr(line, '\n', end - line));
+		if(NULL == lineEnd) lineEnd = end;
+		int best = NONE;
+		for(const char* p = line; best != THCTL; ++p) {
+			p = static_cast< const char* >(::memchr(p, 'L', lineEnd - p));
+			if(NULL == p) break;
+			if(static_cast< size_t >(lineEnd - p) < prefixSize || ::memcmp(p, prefix, prefixSize) != 0) continue;
+			for(int pattern = THCTL; pattern < best; ++pattern) {
+				const size_t suffixSize = ::strlen(suffixes[pattern]);
+				if(static_cast< size_t >(lineEnd - p) - prefixSize >= suffixSize
+						&& ::memcmp(p + prefixSize, suffixes[pattern], suffixSize) == 0) {
+					best = pattern;
+					break;
+				}
+			}
+		}
+		if(best != NONE) ++counts[best];
+		line = (lineEnd == end) ? end : lineEnd + 1;
+	}
+	std::ostringstream tstrTypeStream;
+	if     (counts[THCTL]    != 0) { tstrTypeStream << "DIAMONDX_" << counts[THCTL]; }
+	else if(counts[DXV_VBP]  != 0) { tstrTypeStream << "DXV_" << counts[DXV_VBP]; }
+	else if(counts[EX_BP]    != 0) { tstrTypeStream << "FUSION_" << counts[EX_BP]; }
+	else if(counts[D10_DIBU] != 0) { tstrTypeStream << "DIAMOND10_" << counts[D10_DIBU]; }
+	else tstrTypeStream << "UNKNOWN";
+	return tstrTypeStream.str();
 }
 
 void Xtrf::fillDefaults() {
-	// Default tester name
-	std::string hostName(getenv("LTX_TESTER"));
+	// Default tester name, none if LTX_TESTER is not set
+	const char* ltxTester = ::getenv("LTX_TESTER");
+	std::string hostName((NULL != ltxTester) ? ltxTester : "");
 	std::transform(hostName.begin(), hostName.end(), hostName.begin(), ::toupper);
 	// Remove the trailing -T if any
 	const size_t cutIdx(hostName.find("-T"));
 	if(cutIdx != std::string::npos) {
 		hostName = hostName.substr(0, cutIdx);
 	}
-	set("MIR.NODE_NAM", hostName);
+	set(XTRF_MIR_NODE_NAM, hostName);
 
 	// Detect tester type
-	std::ostringstream stream;
-	stream << getenv("LTXHOME") << "/testers/" << getenv("LTX_TESTER") << "/user_data/utl_iu_data";
-	std::ifstream utlIuData;
-	utlIuData.open(stream.str().c_str());
-	int exBp=0, dxThctl=0, d10Dibu=0, dxvVbp=0;
-	while(!utlIuData.eof()) {
-		std::string rawLine;
-		std::getline(utlIuData, rawLine);
-		if     (rawLine.find("LTXC_PHX_THCTL")    != std::string::npos) { ++dxThctl; }
-		else if(rawLine.find("LTXC_EX_BACKPLANE") != std::string::npos) { ++exBp;    }
-		else if(rawLine.find("LTXC_DMD_DIBU")     != std::string::npos) { ++d10Dibu; }
-		else if(rawLine.find("LTXC_PHX_VBP")      != std::string::npos) { ++dxvVbp;  }
-	}
-	utlIuData.close();
-	std::ostringstream tstrTypeStream;
-	if     (dxThctl != 0) { tstrTypeStream << "DIAMONDX_" << dxThctl; }
-	else if(dxvVbp  != 0) { tstrTypeStream << "DXV_" << dxvVbp; }
-	else if(exBp != 0)    { tstrTypeStream << "FUSION_" << exBp; }
-	else if(d10Dibu != 0) { tstrTypeStream << "DIAMOND10_" << d10Dibu; }
-	else tstrTypeStream << "UNKNOWN";
-	set("MIR.TSTR_TYP", tstrTypeStream.str());
+	set(XTRF_MIR_TSTR_TYP, XtrfTesterProbe::instance().testerType(::getenv("LTXHOME"), ltxTester));
 
 	// Unknown serial number
-	set("MIR.SERL_NUM", "");
+	set(XTRF_MIR_SERL_NUM, "");
 	// Unknown handler type
-	set("SDR.HAND_TYP", "");
+	set(XTRF_SDR_HAND_TYP, "");
 }
 
-bool Xtrf::dumpGdrs(const std::string& fileName) {
-	// tinyxml2 can't generate XML files. Do it the ugly way...
-	// Open destination file
-	std::ofstream gdrXtrfFile;
-	gdrXtrfFile.open(fileName.c_str(), std::ios_base::out);
-	if(!gdrXtrfFile.good()) {
-		m_errorStr = "Failed to write " + fileName + ". Error details:" + ::strerror(errno);
+/**
+ * Buffered XML output. Everything is appended to one large buffer that goes
+ * to the file only when it is full and once more on close, so the number of
+ * write calls depends on the output size, not on the number of lines.
+ */
+class XtrfWriter {
+public:
+	explicit XtrfWriter(bool compact);
+	~XtrfWriter();
+
+	bool open(const std::string& fileName);
+	bool close();
+	void raw(const char* text, size_t size);
+	inline void raw(const char* text) { raw(text, ::strlen(text)); }
+	void escaped(const std::string& value);
+	inline void endLine() { if(!m_compact) raw("\n", 1); }
+	inline int error() const { return m_errno; }
+
+private:
+	static const size_t BufferSize = 1 << 20;
+
+	int m_fd;
+	std::vector< char > m_buffer;
+	size_t m_used;
+	bool m_compact;        /** no line breaks at all */
+	int m_errno;           /** first write error, 0 if none */
+
+	void write(const char* data, size_t size);
+	void flush();
+
+	// disable copy
+	XtrfWriter(const XtrfWriter&);
+	XtrfWriter& operator=(const XtrfWriter&);
+};
+
+XtrfWriter::XtrfWriter(bool compact) :
+	m_fd(-1), m_buffer(BufferSize), m_used(0), m_compact(compact), m_errno(0) {}
+
+XtrfWriter::~XtrfWriter() {
+	if(m_fd >= 0) ::close(m_fd);
+}
+
+bool XtrfWriter::open(const std::string& fileName) {
+	m_fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(m_fd < 0) {
+		m_errno = errno;
+		return false;
+	}
+	return true;
+}
+
+bool XtrfWriter::close() {
+	flush();
+	if(m_fd >= 0 && ::close(m_fd) != 0 && m_errno == 0) m_errno = errno;
+	m_fd = -1;
+	return m_errno == 0;
+}
+
+void XtrfWriter::write(const char* data, size_t size) {
+	while(size > 0 && m_errno == 0) {
+		const ssize_t done = ::write(m_fd, data, size);
+		if(done < 0) {
+			if(errno != EINTR) m_errno = errno;
+			continue;
+		}
+		data += done;
+		size -= static_cast< size_t >(done);
+	}
+}
+
+void XtrfWriter::flush() {
+	write(&m_buffer[0], m_used);
+	m_used = 0;
+}
+
+void XtrfWriter::raw(const char* text, size_t size) {
+	if(m_used + size > m_buffer.size()) {
+		flush();
+		if(size > m_buffer.size()) {
+			write(text, size);
+			return;
+		}
+	}
+	::memcpy(&m_buffer[m_used], text, size);
+	m_used += size;
+}
+
+void XtrfWriter::escaped(const std::string& value) {
+	// Good for text and attribute values. A CR is written as a reference,
+	// the parser would turn a literal one into LF.
+	const char* run = value.data();
+	const char* const end = run + value.size();
+	for(const char* p = run; p != end; ++p) {
+		const char* entity;
+		switch(*p) {
+			case '&': entity = "&amp;"; break;
+			case '<': entity = "&lt;"; break;
+			case '>': entity = "&gt;"; break;
+			case '"': entity = "&quot;"; break;
+			case '\'': entity = "&apos;"; break;
+			case '\r': entity = "&#xD;"; break;
+			default: continue;
+		}
+		raw(run, p - run);
+		raw(entity);
+		run = p + 1;
+	}
+	raw(run, end - run);
+}
+
+bool Xtrf::dumpGdrs(const std::string& fileName, bool compact) {
+	XtrfWriter gdrXtrfFile(compact);
+	if(!gdrXtrfFile.open(fileName)) {
+		m_errorStr = "Failed to write " + fileName + ". Error details:" + ::strerror(gdrXtrfFile.error());
 		return false;
 	}
-	gdrXtrfFile << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-	gdrXtrfFile << "<testerRecipe xmlns=\"urn:st-com:xsd:XTRF.V0150.Generic\">" << std::endl;
-	gdrXtrfFile << "<STDF>" << std::endl;
+	gdrXtrfFile.raw("<?xml version=\"1.0\" encoding=\"UTF-8\"?>");
+	gdrXtrfFile.endLine();
+	gdrXtrfFile.raw("<testerRecipe xmlns=\"urn:st-com:xsd:XTRF.V0150.Generic\">");
+	gdrXtrfFile.endLine();
+	gdrXtrfFile.raw("<STDF>");
+	gdrXtrfFile.endLine();
 	for(std::vector< GdrRecord >::const_iterator gdrRecord = m_gdrRecords.begin();
 			gdrRecord != m_gdrRecords.end(); ++gdrRecord) {
-		gdrXtrfFile << "<STDFrecord recordName=\"GDR\">" << std::endl << "<STDFfields>" << std::endl;
+		gdrXtrfFile.raw("<STDFrecord recordName=\"GDR\">");
+		gdrXtrfFile.endLine();
+		gdrXtrfFile.raw("<STDFfields>");
+		gdrXtrfFile.endLine();
 		for(GdrRecord::const_iterator gdrField = gdrRecord->begin();
 				gdrField != gdrRecord->end(); ++gdrField) {
-			gdrXtrfFile << "<STDFfield fieldName=\"" << gdrField->m_name << "\" ";
-			gdrXtrfFile << "dataType=\"" << gdrField->m_type << "\" required=\"strict\">";
-			gdrXtrfFile << gdrField->m_value << "</STDFfield>" << std::endl;
+			gdrXtrfFile.raw("<STDFfield fieldName=\"");
+			gdrXtrfFile.escaped(gdrField->m_name);
+			gdrXtrfFile.raw("\" dataType=\"");
+			gdrXtrfFile.escaped(gdrField->m_type);
+			gdrXtrfFile.raw("\" required=\"strict\">");
+			gdrXtrfFile.escaped(gdrField->m_value);
+			gdrXtrfFile.raw("</STDFfield>");
+			gdrXtrfFile.endLine();
 		}
-		gdrXtrfFile << "</STDFfields>" << std::endl << "</STDFrecord>" << std::endl;
+		gdrXtrfFile.raw("</STDFfields>");
+		gdrXtrfFile.endLine();
+		gdrXtrfFile.raw("</STDFrecord>");
+		gdrXtrfFile.endLine();
+	}
+	gdrXtrfFile.raw("</STDF>");
+	gdrXtrfFile.endLine();
+	gdrXtrfFile.raw("</testerRecipe>");
+	gdrXtrfFile.endLine();
+	if(!gdrXtrfFile.close()) {
+		m_errorStr = "Failed to write " + fileName + ". Error details:" + ::strerror(gdrXtrfFile.error());
+		return false;
 	}
-	gdrXtrfFile << "</STDF>" << std::endl << "</testerRecipe>" << std::endl;
-	gdrXtrfFile.close();
 	return true;
 }
 
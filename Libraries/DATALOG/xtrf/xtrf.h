@@ -3,6 +3,12 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <sys/stat.h>
 #include <tinyxml2.h>
 
 namespace tinyxtrf {
@@ -19,31 +25,258 @@ public:
 
 typedef std::vector< GdrField > GdrRecord;
 
+/** STDF type of a GDR GEN_DATA value */
+enum GdrDataType { GDR_CN, GDR_I1, GDR_I2, GDR_I4, GDR_U1, GDR_U2, GDR_U4, GDR_R4, GDR_R8 };
+
+/** One GEN_DATA value of a GDR, converted from its text once at parse time */
+class GdrData {
+public:
+	GdrDataType m_type;
+	int m_int;            /** I*1, I*2, I*4 */
+	unsigned int m_uint;  /** U*1, U*2, U*4 */
+	double m_real;        /** R*4, R*8 */
+	std::string m_str;    /** C*n */
+
+	GdrData(GdrDataType type) : m_type(type), m_int(0), m_uint(0), m_real(0.0), m_str() {}
+};
+
+/** The values a GDR record writes, in order */
+typedef std::vector< GdrData > GdrDataList;
+
+GdrDataList compileGdr(const GdrRecord& gdr);
+
+/** STDF fields known by name, their token ids are fixed. Other record.field names get ids as they are seen. */
+enum XtrfTokenId {
+	XTRF_MIR_SETUP_T, XTRF_MIR_START_T, XTRF_MIR_STAT_NUM, XTRF_MIR_MODE_COD, XTRF_MIR_RTST_COD, XTRF_MIR_PROT_COD,
+	XTRF_MIR_BURN_TIM, XTRF_MIR_CMOD_COD, XTRF_MIR_LOT_ID, XTRF_MIR_PART_TYP, XTRF_MIR_NODE_NAM, XTRF_MIR_TSTR_TYP,
+	XTRF_MIR_JOB_NAM, XTRF_MIR_JOB_REV, XTRF_MIR_SBLOT_ID, XTRF_MIR_OPER_NAM, XTRF_MIR_EXEC_TYP, XTRF_MIR_EXEC_VER,
+	XTRF_MIR_TEST_COD, XTRF_MIR_TST_TEMP, XTRF_MIR_USER_TXT, XTRF_MIR_AUX_FILE, XTRF_MIR_PKG_TYP, XTRF_MIR_FAMLY_ID,
+	XTRF_MIR_DATE_COD, XTRF_MIR_FACIL_ID, XTRF_MIR_FLOOR_ID, XTRF_MIR_PROC_ID, XTRF_MIR_OPER_FRQ, XTRF_MIR_SPEC_NAM,
+	XTRF_MIR_SPEC_VER, XTRF_MIR_FLOW_ID, XTRF_MIR_SETUP_ID, XTRF_MIR_DSGN_REV, XTRF_MIR_ENG_ID, XTRF_MIR_ROM_COD,
+	XTRF_MIR_SERL_NUM, XTRF_MIR_SUPR_NAM,
+	XTRF_SDR_HEAD_NUM, XTRF_SDR_SITE_GRP, XTRF_SDR_HAND_TYP, XTRF_SDR_HAND_ID, XTRF_SDR_CARD_TYP, XTRF_SDR_CARD_ID,
+	XTRF_SDR_LOAD_TYP, XTRF_SDR_LOAD_ID, XTRF_SDR_DIB_TYP, XTRF_SDR_DIB_ID, XTRF_SDR_CABL_TYP, XTRF_SDR_CABL_ID,
+	XTRF_SDR_CONT_TYP, XTRF_SDR_CONT_ID, XTRF_SDR_LASR_TYP, XTRF_SDR_LASR_ID, XTRF_SDR_EXTR_TYP, XTRF_SDR_EXTR_ID,
+	XTRF_MRR_FINISH_T, XTRF_MRR_DISP_COD, XTRF_MRR_USR_DESC, XTRF_MRR_EXC_DESC,
+	XTRF_NUM_KNOWN_TOKENS
+};
+
+/** Field values by token id ("MIR.NODE_NAM" and so on), in flat arrays */
+class XtrfFields {
+public:
+	static int find(const std::string& token);
+	static int intern(const std::string& token);
+	static int intern(const std::string& recordName, const std::string& fieldName);
+	static const std::string& name(int id);
+
+	XtrfFields() : m_values(), m_isSet(), m_setIds() {}
+
+	const std::string* find(int id) const;
+	const std::string& get(int id) const;
+	void set(int id, const std::string& value);
+	void swap(int id, std::string& value);
+	void clear();
+	void swap(XtrfFields& fields);
+	inline bool empty() const { return m_setIds.empty(); }
+	inline size_t size() const { return m_setIds.size(); }
+	inline const std::vector< int >& ids() const { return m_setIds; } /** ids that have a value, first set first */
+
+private:
+	std::vector< std::string > m_values;
+	std::vector< unsigned char > m_isSet;
+	std::vector< int > m_setIds;
+};
+
+/** stat identity of a file, to tell whether it changed since it was read */
+class XtrfFileStamp {
+public:
+	unsigned long m_device;
+	unsigned long m_inode;
+	long long m_size;
+	long long m_mtimeSec;
+	long m_mtimeNsec;
+
+	XtrfFileStamp() : m_device(0), m_inode(0), m_size(-1), m_mtimeSec(0), m_mtimeNsec(0) {}
+
+	bool matches(const struct stat& fileStat) const;
+	void set(const struct stat& fileStat);
+};
+
+/** What one XTRF file contributed, kept while the file is unchanged */
+class XtrfCacheEntry {
+public:
+	XtrfFileStamp m_stamp;           /** file that was parsed */
+	unsigned long long m_hash;       /** FNV-1a of the file content */
+	XtrfFields m_stdFields;
+	std::vector< GdrRecord > m_gdrRecords;
+	std::vector< GdrDataList > m_gdrData;
+
+	XtrfCacheEntry() : m_stamp(), m_hash(0), m_stdFields(), m_gdrRecords(), m_gdrData() {}
+};
+
+/** One line of the GNB tester table: name, serial number, model, handler type */
+class XtrfTester {
+public:
+	std::string m_name;
+	std::string m_serialNum;
+	std::string m_model;
+	std::string m_handlerType;
+
+	XtrfTester() : m_name(), m_serialNum(), m_model(), m_handlerType() {}
+};
+
+/** Parse results as handed to readers, never modified once published */
+class XtrfSnapshot {
+public:
+	XtrfFields m_stdFields;
+	std::vector< GdrRecord > m_gdrRecords;
+	std::vector< GdrDataList > m_gdrData;
+
+	XtrfSnapshot() : m_stdFields(), m_gdrRecords(), m_gdrData() {}
+
+	inline const std::string& get(XtrfTokenId token) const { return m_stdFields.get(token); }
+	inline const std::string& get(const std::string& token) const { return m_stdFields.get(XtrfFields::find(token)); }
+};
+
 class Xtrf {
+	friend class XtrfReloader;
+	friend class XtrfGdrChannel;
+
+public:
+	enum ParseMode {
+		PARSE_DOM,    /** load a tinyxml2 DOM, then walk it */
+		PARSE_STREAM  /** one pass pull scan in 64 KB chunks, no DOM: memory does not grow with the file */
+	};
+
 private:
-	std::map< std::string, std::string > m_stdFields; /** Map to store all fields, except GDR */
+	XtrfFields m_stdFields; /** All fields by token id, except GDR */
 	std::vector< GdrRecord > m_gdrRecords;
+	std::vector< GdrDataList > m_gdrData; /** m_gdrRecords compiled to typed values */
 	std::string m_errorStr;
+	std::map< std::string, XtrfCacheEntry > m_parseCache; /** Parse results by file name */
+	unsigned long m_cacheHits;
+	unsigned long m_cacheMisses;
+	unsigned long m_sidecarHits;
+	ParseMode m_parseMode;
+	bool m_useSidecar;   /** load from and save to the datalog cache directory */
+	std::vector< std::unique_ptr< tinyxml2::XMLDocument > > m_documents; /** kept for PARSE_DOM, memory reused */
+	std::string m_testerTableFile;
+	XtrfFileStamp m_testerTableStamp;
+	std::unordered_map< std::string, XtrfTester > m_testerTable; /** by tester name, first line wins */
+	std::shared_ptr< const XtrfSnapshot > m_published;
+	mutable std::mutex m_publishMutex; /** guards m_published, held only to copy or swap the pointer */
 
 public:
-	const std::string get(const std::string& token);
+	const std::string& get(const std::string& token);
+	inline const std::string& get(XtrfTokenId token) { return m_stdFields.get(token); }
 	bool parse(const std::string& file);
+	bool parse(const std::vector< std::string >& files, unsigned threads = 0); /** concurrently, merged in list order; threads 0: up to 4 */
+	bool reload(const std::string& file);
 	bool loadGnbTesterTable(const std::string& fileName, const std::string& testerName);
-	bool dumpGdrs(const std::string& fileName);
+	bool dumpGdrs(const std::string& fileName, bool compact = false); /** compact: no line breaks */
 
-	inline void addGdr(const GdrRecord& gdr) { m_gdrRecords.push_back(gdr); }
-	inline const std::map< std::string, std::string >& get() { return m_stdFields; }
+	inline void addGdr(const GdrRecord& gdr) { m_gdrRecords.push_back(gdr); m_gdrData.push_back(compileGdr(gdr)); }
+	inline const XtrfFields& get() { return m_stdFields; }
 	inline const std::vector< GdrRecord >& gdrs() { return m_gdrRecords; }
-	inline void clear() { m_stdFields.clear(); m_gdrRecords.clear(); }
+	inline const std::vector< GdrDataList >& gdrData() { return m_gdrData; }
+	inline void clear() { m_stdFields.clear(); m_gdrRecords.clear(); m_gdrData.clear(); }
 	inline const std::string getError() { return m_errorStr; }
+	inline unsigned long cacheHits() const { return m_cacheHits; }
+	inline unsigned long cacheMisses() const { return m_cacheMisses; }
+	inline unsigned long sidecarHits() const { return m_sidecarHits; }
+	inline void clearCache() { m_parseCache.clear(); }
+	inline void setParseMode(ParseMode mode) { m_parseMode = mode; }
+	inline ParseMode parseMode() const { return m_parseMode; }
+	inline void setSidecar(bool use) { m_useSidecar = use; }
+	inline bool sidecar() const { return m_useSidecar; }
+	void publish(); /** a copy of the current content becomes what snapshot() returns */
+	void publish(const std::shared_ptr< const XtrfSnapshot >& snapshot);
+	std::shared_ptr< const XtrfSnapshot > snapshot() const; /** last published, never NULL, safe from any thread */
 
 	static Xtrf* instance();
+	static std::vector< std::string > expandSources(const std::string& sources, std::vector< std::string >* unmatched = NULL); /** unmatched gets the entries that named no file */
 
 private:
-	Xtrf():	m_stdFields(), m_gdrRecords(), m_errorStr() {}
-	void set(const std::string& token, const std::string& value);
+	/** instance() is the one the datalog shares, the others are workers of parse(files) and the friends */
+	Xtrf():	m_stdFields(), m_gdrRecords(), m_gdrData(), m_errorStr(), m_parseCache(), m_cacheHits(0), m_cacheMisses(0), m_sidecarHits(0), m_parseMode(PARSE_DOM), m_useSidecar(false), m_documents(),
+		m_testerTableFile(), m_testerTableStamp(), m_testerTable(), m_published(std::make_shared< const XtrfSnapshot >()), m_publishMutex() {}
+
+	void set(int token, const std::string& value);
+	XtrfCacheEntry* load(const std::string& file);
+	bool parseContent(const char* content, size_t size, XtrfCacheEntry& entry);
+	void merge(const XtrfCacheEntry& entry);
 	void processRecord(const char* recordName, tinyxml2::XMLElement* stdfRecordElt);
 	void fillDefaults();
+	bool loadTesterTable(const std::string& fileName);
+	std::shared_ptr< XtrfSnapshot > takeSnapshot();
+};
+
+/**
+ * Keeps the snapshot of an Xtrf in step with its recipe files. A thread waits
+ * on inotify for the files to be rewritten or replaced, parses them again in
+ * its own Xtrf and publishes the result to the target, which readers keep
+ * using meanwhile. The target's own content is not touched.
+ */
+class XtrfReloader {
+public:
+	XtrfReloader(Xtrf& target, const std::vector< std::string >& files, Xtrf::ParseMode mode);
+	~XtrfReloader();
+
+	bool start(); /** parse and publish once, then watch; false if watching is not possible */
+	void stop();
+	bool sync();  /** reload now if a file changed since the last reload, on the calling thread */
+	inline const std::vector< std::string >& files() const { return m_files; }
+	inline Xtrf::ParseMode parseMode() const { return m_worker.parseMode(); }
+	inline bool sidecar() const { return m_worker.sidecar(); }
+	inline unsigned long reloads() const { return m_reloads; }
+	std::string error();
+
+private:
+	Xtrf& m_target;
+	const std::vector< std::string > m_files;
+	Xtrf m_worker;
+	std::vector< XtrfFileStamp > m_stamps;  /** of m_files at the last reload */
+	std::string m_error;
+	std::mutex m_mutex;                     /** serializes reloads */
+	std::atomic< unsigned long > m_reloads;
+	int m_inotifyFd;
+	int m_stopPipe[2];
+	std::thread m_thread;
+
+	bool changed();
+	bool reload();
+	void run();
+
+	// disable copy
+	XtrfReloader(const XtrfReloader&);
+	XtrfReloader& operator=(const XtrfReloader&);
+};
+
+/**
+ * GDRs handed over in shared memory, a POSIX shm segment (/dev/shm/<name>)
+ * holding a versioned header and the compiled GDR values, instead of an
+ * XTRF file the datalog has to parse. The producer owns the segment: it
+ * writes the GDRs of the lot and removes it when they are no longer valid.
+ * One producer at a time; readers never block it.
+ */
+class XtrfGdrChannel {
+public:
+	explicit XtrfGdrChannel(const std::string& name) : m_name(name), m_error() {}
+
+	bool read(std::vector< GdrDataList >& gdrData); /** false with error() empty when there is no segment */
+	bool write(const std::vector< GdrDataList >& gdrData);
+	bool writeFile(const std::string& xtrfFile);    /** producer stub: the GDRs of an XTRF file */
+	bool remove();
+	inline const std::string& name() const { return m_name; }
+	inline const std::string& error() const { return m_error; }
+
+	static std::string defaultName(); /** per user: /st_dlog_gdr_<euid> */
+
+private:
+	std::string m_name;
+	std::string m_error;
+
+	std::string path() const;
 };
 
 } // namespace tinyxtrf